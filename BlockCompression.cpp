@@ -0,0 +1,405 @@
+#include "BlockCompression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    size_t GetBlockBytes(BlockFormat format)
+    {
+        return format == BLOCK_BC1 ? 8 : 16;
+    }
+
+    size_t GetCompressedSize(BlockFormat format, int width, int height)
+    {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockBytes(format);
+    }
+
+    static unsigned short PackRGB565(const float color[3])
+    {
+        int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+        int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+        int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+        return (unsigned short)((r << 11) | (g << 5) | b);
+    }
+
+    static void UnpackRGB565(unsigned short packed, int color[3])
+    {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // The four colors of an opaque block
+    static void BuildPalette(unsigned short color0, unsigned short color1, int palette[4][3])
+    {
+        UnpackRGB565(color0, palette[0]);
+        UnpackRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    }
+
+    // Picks the nearest palette entry per texel; returns the squared error
+    static int SelectIndices(const unsigned char rgba[64], const int palette[4][3], unsigned char indices[16])
+    {
+        int totalError = 0;
+        for (int i = 0; i < 16; i++) {
+            int bestError = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int dr = rgba[4 * i + 0] - palette[p][0];
+                int dg = rgba[4 * i + 1] - palette[p][1];
+                int db = rgba[4 * i + 2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) {
+                    bestError = error;
+                    indices[i] = (unsigned char)p;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    // Endpoints along the principal axis of the block colors, slightly inset
+    static void FindPrincipalEndpoints(const unsigned char rgba[64], float start[3], float end[3])
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++) {
+                mean[c] += rgba[4 * i + c] / 16.0f;
+            }
+        }
+
+        float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++) {
+            float r = rgba[4 * i + 0] - mean[0], g = rgba[4 * i + 1] - mean[1], b = rgba[4 * i + 2] - mean[2];
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+
+        // power iteration
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+            float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+            float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+            float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+            if (length < 1e-6f) {
+                break; // flat block, any axis will do
+            }
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+        float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        for (int c = 0; c < 3; c++) {
+            axis[c] /= axisLength;
+        }
+
+        float minimum = 1e30f, maximum = -1e30f;
+        for (int i = 0; i < 16; i++) {
+            float t = (rgba[4 * i + 0] - mean[0]) * axis[0] + (rgba[4 * i + 1] - mean[1]) * axis[1] +
+                (rgba[4 * i + 2] - mean[2]) * axis[2];
+            minimum = std::min(minimum, t);
+            maximum = std::max(maximum, t);
+        }
+        float inset = (maximum - minimum) / 16.0f;
+        minimum += inset;
+        maximum -= inset;
+
+        for (int c = 0; c < 3; c++) {
+            start[c] = mean[c] + axis[c] * maximum;
+            end[c] = mean[c] + axis[c] * minimum;
+        }
+    }
+
+    // Least-squares endpoints for a fixed index assignment
+    static bool RefineEndpoints(const unsigned char rgba[64], const unsigned char indices[16], float start[3], float end[3])
+    {
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++) {
+            float a = weights[indices[i]], b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < 3; c++) {
+                ax[c] += a * rgba[4 * i + c];
+                bx[c] += b * rgba[4 * i + c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f) {
+            return false;
+        }
+        for (int c = 0; c < 3; c++) {
+            start[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+            end[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+        }
+        return true;
+    }
+
+    static void WriteColorBlock(unsigned short color0, unsigned short color1, const unsigned char indices[16], unsigned char block[8])
+    {
+        // color0 > color1 selects the opaque four-color mode
+        static const unsigned char swapped[4] = { 1, 0, 3, 2 };
+        bool swap = color0 < color1;
+        if (swap) {
+            std::swap(color0, color1);
+        }
+
+        block[0] = (unsigned char)(color0 & 0xff);
+        block[1] = (unsigned char)(color0 >> 8);
+        block[2] = (unsigned char)(color1 & 0xff);
+        block[3] = (unsigned char)(color1 >> 8);
+        for (int row = 0; row < 4; row++) {
+            unsigned char bits = 0;
+            for (int column = 0; column < 4; column++) {
+                unsigned char index = color0 == color1 ? 0 : indices[4 * row + column];
+                if (swap) {
+                    index = swapped[index];
+                }
+                bits |= (unsigned char)(index << (2 * column));
+            }
+            block[4 + row] = bits;
+        }
+    }
+
+    void EncodeBC1Block(const unsigned char rgba[64], unsigned char block[8])
+    {
+        float start[3], end[3];
+        FindPrincipalEndpoints(rgba, start, end);
+
+        unsigned short color0 = PackRGB565(start), color1 = PackRGB565(end);
+        int palette[4][3];
+        unsigned char indices[16];
+        BuildPalette(color0, color1, palette);
+        int error = SelectIndices(rgba, palette, indices);
+
+        // one refinement pass, kept only if it helps
+        if (error > 0 && RefineEndpoints(rgba, indices, start, end)) {
+            unsigned short refined0 = PackRGB565(start), refined1 = PackRGB565(end);
+            int refinedPalette[4][3];
+            unsigned char refinedIndices[16];
+            BuildPalette(refined0, refined1, refinedPalette);
+            if (SelectIndices(rgba, refinedPalette, refinedIndices) < error) {
+                color0 = refined0;
+                color1 = refined1;
+                memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+
+        WriteColorBlock(color0, color1, indices, block);
+    }
+
+    static void EncodeAlphaBlock(const unsigned char rgba[64], unsigned char block[8])
+    {
+        int alpha0 = 0, alpha1 = 255;
+        for (int i = 0; i < 16; i++) {
+            alpha0 = std::max(alpha0, (int)rgba[4 * i + 3]);
+            alpha1 = std::min(alpha1, (int)rgba[4 * i + 3]);
+        }
+
+        // alpha0 > alpha1 selects the eight-value mode
+        int values[8];
+        values[0] = alpha0;
+        values[1] = alpha1;
+        for (int k = 2; k < 8; k++) {
+            values[k] = ((8 - k) * alpha0 + (k - 1) * alpha1) / 7;
+        }
+
+        unsigned long long bits = 0;
+        if (alpha0 != alpha1) {
+            for (int i = 0; i < 16; i++) {
+                int best = 0, bestError = 256;
+                for (int k = 0; k < 8; k++) {
+                    int error = std::abs(rgba[4 * i + 3] - values[k]);
+                    if (error < bestError) {
+                        bestError = error;
+                        best = k;
+                    }
+                }
+                bits |= (unsigned long long)best << (3 * i);
+            }
+        }
+
+        block[0] = (unsigned char)alpha0;
+        block[1] = (unsigned char)alpha1;
+        for (int b = 0; b < 6; b++) {
+            block[2 + b] = (unsigned char)(bits >> (8 * b));
+        }
+    }
+
+    void EncodeBC3Block(const unsigned char rgba[64], unsigned char block[16])
+    {
+        EncodeAlphaBlock(rgba, block);
+        EncodeBC1Block(rgba, block + 8);
+    }
+
+    static void DecodeColorBlock(const unsigned char block[8], bool allowTransparent, unsigned char rgba[64])
+    {
+        unsigned short color0 = (unsigned short)(block[0] | (block[1] << 8));
+        unsigned short color1 = (unsigned short)(block[2] | (block[3] << 8));
+        int palette[4][3];
+        BuildPalette(color0, color1, palette);
+        bool threeColor = allowTransparent && color0 <= color1;
+        if (threeColor) {
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+
+        for (int i = 0; i < 16; i++) {
+            int index = (block[4 + i / 4] >> (2 * (i % 4))) & 3;
+            rgba[4 * i + 0] = (unsigned char)palette[index][0];
+            rgba[4 * i + 1] = (unsigned char)palette[index][1];
+            rgba[4 * i + 2] = (unsigned char)palette[index][2];
+            rgba[4 * i + 3] = (unsigned char)(threeColor && index == 3 ? 0 : 255);
+        }
+    }
+
+    void DecodeBC1Block(const unsigned char block[8], unsigned char rgba[64])
+    {
+        DecodeColorBlock(block, true, rgba);
+    }
+
+    void DecodeBC3Block(const unsigned char block[16], unsigned char rgba[64])
+    {
+        // the color half of a BC3 block is always read in four-color mode
+        DecodeColorBlock(block + 8, false, rgba);
+
+        int alpha0 = block[0], alpha1 = block[1];
+        int values[8];
+        values[0] = alpha0;
+        values[1] = alpha1;
+        if (alpha0 > alpha1) {
+            for (int k = 2; k < 8; k++) {
+                values[k] = ((8 - k) * alpha0 + (k - 1) * alpha1) / 7;
+            }
+        } else {
+            for (int k = 2; k < 6; k++) {
+                values[k] = ((6 - k) * alpha0 + (k - 1) * alpha1) / 5;
+            }
+            values[6] = 0;
+            values[7] = 255;
+        }
+
+        unsigned long long bits = 0;
+        for (int b = 0; b < 6; b++) {
+            bits |= (unsigned long long)block[2 + b] << (8 * b);
+        }
+        for (int i = 0; i < 16; i++) {
+            rgba[4 * i + 3] = (unsigned char)values[(bits >> (3 * i)) & 7];
+        }
+    }
+
+    std::vector<unsigned char> CompressImage(const unsigned char* rgba, int width, int height, BlockFormat format)
+    {
+        size_t blockBytes = GetBlockBytes(format);
+        std::vector<unsigned char> blocks(GetCompressedSize(format, width, height));
+        unsigned char texels[64];
+
+        size_t offset = 0;
+        for (int blockY = 0; blockY < height; blockY += 4) {
+            for (int blockX = 0; blockX < width; blockX += 4) {
+                for (int y = 0; y < 4; y++) {
+                    for (int x = 0; x < 4; x++) {
+                        int sourceX = std::min(blockX + x, width - 1), sourceY = std::min(blockY + y, height - 1);
+                        memcpy(texels + 4 * (4 * y + x), rgba + 4 * ((size_t)sourceY * width + sourceX), 4);
+                    }
+                }
+                if (format == BLOCK_BC1) {
+                    EncodeBC1Block(texels, &blocks[offset]);
+                } else {
+                    EncodeBC3Block(texels, &blocks[offset]);
+                }
+                offset += blockBytes;
+            }
+        }
+        return blocks;
+    }
+
+    std::vector<unsigned char> DecompressImage(const unsigned char* blocks, int width, int height, BlockFormat format)
+    {
+        size_t blockBytes = GetBlockBytes(format);
+        std::vector<unsigned char> rgba((size_t)width * height * 4);
+        unsigned char texels[64];
+
+        for (int blockY = 0; blockY < height; blockY += 4) {
+            for (int blockX = 0; blockX < width; blockX += 4) {
+                if (format == BLOCK_BC1) {
+                    DecodeBC1Block(blocks, texels);
+                } else {
+                    DecodeBC3Block(blocks, texels);
+                }
+                blocks += blockBytes;
+                for (int y = 0; y < 4 && blockY + y < height; y++) {
+                    for (int x = 0; x < 4 && blockX + x < width; x++) {
+                        memcpy(&rgba[4 * ((size_t)(blockY + y) * width + blockX + x)], texels + 4 * (4 * y + x), 4);
+                    }
+                }
+            }
+        }
+        return rgba;
+    }
+
+    // Reverses the first `rows` texel rows of a block: one index byte per row in the
+    // color block, 12 index bits per row in the BC3 alpha block
+    static void FlipBlock(unsigned char* block, int rows, BlockFormat format)
+    {
+        unsigned char* color = block;
+        if (format == BLOCK_BC3) {
+            unsigned long long bits = 0;
+            for (int b = 0; b < 6; b++) {
+                bits |= (unsigned long long)block[2 + b] << (8 * b);
+            }
+            unsigned long long flipped = bits;
+            for (int row = 0; row < rows; row++) {
+                unsigned long long rowBits = (bits >> (12 * row)) & 0xfff;
+                flipped &= ~(0xfffULL << (12 * (rows - 1 - row)));
+                flipped |= rowBits << (12 * (rows - 1 - row));
+            }
+            for (int b = 0; b < 6; b++) {
+                block[2 + b] = (unsigned char)(flipped >> (8 * b));
+            }
+            color = block + 8;
+        }
+        std::reverse(color + 4, color + 4 + rows);
+    }
+
+    void FlipCompressedImage(std::vector<unsigned char>& blocks, int width, int height, BlockFormat format)
+    {
+        size_t blockBytes = GetBlockBytes(format);
+        if (height % 4 != 0 && height > 4) {
+            std::vector<unsigned char> rgba = DecompressImage(&blocks[0], width, height, format);
+            size_t rowBytes = (size_t)width * 4;
+            for (int y = 0; y < height / 2; y++) {
+                std::swap_ranges(rgba.begin() + y * rowBytes, rgba.begin() + (y + 1) * rowBytes,
+                    rgba.begin() + (height - 1 - y) * rowBytes);
+            }
+            blocks = CompressImage(&rgba[0], width, height, format);
+            return;
+        }
+
+        size_t rowBytes = (size_t)((width + 3) / 4) * blockBytes;
+        int blockRows = (height + 3) / 4;
+        for (int row = 0; row < blockRows / 2; row++) {
+            std::swap_ranges(blocks.begin() + row * rowBytes, blocks.begin() + (row + 1) * rowBytes,
+                blocks.begin() + (blockRows - 1 - row) * rowBytes);
+        }
+        int rows = std::min(height, 4);
+        for (size_t offset = 0; offset < blocks.size(); offset += blockBytes) {
+            FlipBlock(&blocks[offset], rows, format);
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef BlockCompression_hpp
+#define BlockCompression_hpp
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // CPU encoder and decoder for the S3TC/BC block formats. Works on 4x4 blocks
+    // of RGBA8 texels and needs no GL context, so it can run offline or headless.
+    enum BlockFormat
+    {
+        BLOCK_BC1, // 8 bytes per block, opaque RGB
+        BLOCK_BC3  // 16 bytes per block, RGB plus interpolated alpha
+    };
+
+    size_t GetBlockBytes(BlockFormat format);
+
+    // Bytes needed for a width x height image (partial blocks round up)
+    size_t GetCompressedSize(BlockFormat format, int width, int height);
+
+    void EncodeBC1Block(const unsigned char rgba[64], unsigned char block[8]);
+    void EncodeBC3Block(const unsigned char rgba[64], unsigned char block[16]);
+    void DecodeBC1Block(const unsigned char block[8], unsigned char rgba[64]);
+    void DecodeBC3Block(const unsigned char block[16], unsigned char rgba[64]);
+
+    // Compresses a whole RGBA8 image; edge blocks repeat the last row/column
+    std::vector<unsigned char> CompressImage(const unsigned char* rgba, int width, int height, BlockFormat format);
+    std::vector<unsigned char> DecompressImage(const unsigned char* blocks, int width, int height, BlockFormat format);
+
+    // Turns a compressed image upside down. Heights that are a multiple of 4 or below 4
+    // (every power of two) are flipped in place by reordering block rows and the index
+    // rows inside the blocks; other heights are decoded, flipped and encoded again.
+    void FlipCompressedImage(std::vector<unsigned char>& blocks, int width, int height, BlockFormat format);
+}
+
+#endif /* BlockCompression_hpp */
@@ -0,0 +1,445 @@
+#include "Bvh.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <future>
+
+namespace gps {
+
+    static const int SAH_BINS = 16;
+    // subtrees at most this large are built by one task
+    static const GLuint PARALLEL_GRAIN = 16 * 1024;
+
+    enum BoxClass { BOX_OUTSIDE, BOX_INTERSECTING, BOX_INSIDE };
+
+    // Node with explicit children, used while subtrees are built apart
+    struct BuildNode
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+        GLuint first;
+        GLuint count;
+        int left;     // -1 for leaves
+        int right;
+        int subtree;  // top level only: index of the job that builds this node, -1 otherwise
+    };
+
+    struct BuildJob
+    {
+        GLuint first;
+        GLuint count;
+        std::vector<BuildNode> nodes;
+    };
+
+    static inline const glm::vec3& Position(const glm::vec3* positions, size_t strideBytes, GLuint vertex)
+    {
+        return *(const glm::vec3*)((const unsigned char*)positions + vertex * strideBytes);
+    }
+
+    static inline float HalfArea(const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 d = max - min;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    class BvhBuilder
+    {
+    public:
+        // per triangle, indexed by the original triangle number
+        std::vector<glm::vec3> boundsMin;
+        std::vector<glm::vec3> boundsMax;
+        std::vector<glm::vec3> centroids;
+        // triangle numbers in node order, partitioned in place
+        std::vector<GLuint> order;
+
+        BuildNode MakeNode(GLuint first, GLuint count) const
+        {
+            BuildNode node;
+            node.min = glm::vec3(FLT_MAX);
+            node.max = glm::vec3(-FLT_MAX);
+            for (GLuint i = first; i < first + count; i++) {
+                node.min = glm::min(node.min, boundsMin[order[i]]);
+                node.max = glm::max(node.max, boundsMax[order[i]]);
+            }
+            node.first = first;
+            node.count = count;
+            node.left = -1;
+            node.right = -1;
+            node.subtree = -1;
+            return node;
+        }
+
+        // Partitions the node's triangles with the cheapest binned SAH split and
+        // returns how many went left, or 0 if the node stays a leaf
+        GLuint Split(const BuildNode& node)
+        {
+            if (node.count <= Bvh::MAX_LEAF_TRIANGLES) {
+                return 0;
+            }
+
+            glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+            for (GLuint i = node.first; i < node.first + node.count; i++) {
+                centroidMin = glm::min(centroidMin, centroids[order[i]]);
+                centroidMax = glm::max(centroidMax, centroids[order[i]]);
+            }
+
+            float bestCost = FLT_MAX;
+            int bestAxis = -1, bestBin = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                float extent = centroidMax[axis] - centroidMin[axis];
+                if (extent <= 0.0f) {
+                    continue;
+                }
+                float scale = SAH_BINS / extent;
+
+                GLuint counts[SAH_BINS] = { 0 };
+                glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+                for (int b = 0; b < SAH_BINS; b++) {
+                    binMin[b] = glm::vec3(FLT_MAX);
+                    binMax[b] = glm::vec3(-FLT_MAX);
+                }
+                for (GLuint i = node.first; i < node.first + node.count; i++) {
+                    GLuint t = order[i];
+                    int b = std::min((int)((centroids[t][axis] - centroidMin[axis]) * scale), SAH_BINS - 1);
+                    counts[b]++;
+                    binMin[b] = glm::min(binMin[b], boundsMin[t]);
+                    binMax[b] = glm::max(binMax[b], boundsMax[t]);
+                }
+
+                // sweep from the right, then from the left evaluating each split plane
+                float rightCost[SAH_BINS];
+                glm::vec3 accumulatedMin(FLT_MAX), accumulatedMax(-FLT_MAX);
+                GLuint accumulated = 0;
+                for (int b = SAH_BINS - 1; b > 0; b--) {
+                    accumulated += counts[b];
+                    accumulatedMin = glm::min(accumulatedMin, binMin[b]);
+                    accumulatedMax = glm::max(accumulatedMax, binMax[b]);
+                    rightCost[b] = accumulated ? HalfArea(accumulatedMin, accumulatedMax) * accumulated : 0.0f;
+                }
+                accumulatedMin = glm::vec3(FLT_MAX);
+                accumulatedMax = glm::vec3(-FLT_MAX);
+                accumulated = 0;
+                for (int b = 0; b < SAH_BINS - 1; b++) {
+                    accumulated += counts[b];
+                    accumulatedMin = glm::min(accumulatedMin, binMin[b]);
+                    accumulatedMax = glm::max(accumulatedMax, binMax[b]);
+                    if (accumulated == 0 || accumulated == node.count) {
+                        continue;
+                    }
+                    float cost = HalfArea(accumulatedMin, accumulatedMax) * accumulated + rightCost[b + 1];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = b + 1;
+                    }
+                }
+            }
+
+            GLuint left = 0;
+            if (bestAxis >= 0) {
+                float scale = SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+                float origin = centroidMin[bestAxis];
+                const std::vector<glm::vec3>& c = centroids;
+                std::vector<GLuint>::iterator begin = order.begin() + node.first;
+                std::vector<GLuint>::iterator middle = std::partition(begin, begin + node.count, [&](GLuint t) {
+                    return std::min((int)((c[t][bestAxis] - origin) * scale), SAH_BINS - 1) < bestBin;
+                });
+                left = (GLuint)(middle - begin);
+            }
+            // every centroid in one spot: any split is as good as another
+            if (left == 0 || left == node.count) {
+                left = node.count / 2;
+            }
+            return left;
+        }
+
+        int BuildRecursive(GLuint first, GLuint count, std::vector<BuildNode>& out)
+        {
+            int index = (int)out.size();
+            out.push_back(MakeNode(first, count));
+            GLuint left = Split(out[index]);
+            if (left) {
+                int leftChild = BuildRecursive(first, left, out);
+                int rightChild = BuildRecursive(first + left, count - left, out);
+                out[index].left = leftChild;
+                out[index].right = rightChild;
+            }
+            return index;
+        }
+
+        // Splits serially until the pieces are small enough to hand to the pool
+        int BuildTop(GLuint first, GLuint count, std::vector<BuildNode>& top, std::vector<BuildJob>& jobs)
+        {
+            int index = (int)top.size();
+            top.push_back(MakeNode(first, count));
+            if (count <= PARALLEL_GRAIN) {
+                BuildJob job;
+                job.first = first;
+                job.count = count;
+                top[index].subtree = (int)jobs.size();
+                jobs.push_back(job);
+                return index;
+            }
+
+            GLuint left = Split(top[index]);
+            int leftChild = BuildTop(first, left, top, jobs);
+            int rightChild = BuildTop(first + left, count - left, top, jobs);
+            top[index].left = leftChild;
+            top[index].right = rightChild;
+            return index;
+        }
+
+        static void Emit(const std::vector<BuildNode>& source, int index, const std::vector<BuildJob>& jobs,
+            std::vector<BvhNode>& nodes)
+        {
+            const BuildNode& node = source[index];
+            if (node.subtree >= 0) {
+                Emit(jobs[node.subtree].nodes, 0, jobs, nodes);
+                return;
+            }
+
+            size_t at = nodes.size();
+            BvhNode flat;
+            flat.min = node.min;
+            flat.max = node.max;
+            flat.firstTriangle = node.first;
+            flat.triangleCount = node.count;
+            flat.rightChild = 0;
+            nodes.push_back(flat);
+            if (node.left >= 0) {
+                Emit(source, node.left, jobs, nodes);
+                nodes[at].rightChild = (GLuint)nodes.size();
+                Emit(source, node.right, jobs, nodes);
+            }
+        }
+    };
+
+    void Bvh::Build(const glm::vec3* positions, size_t strideBytes, GLuint* indices, size_t indexCount)
+    {
+        nodes.clear();
+        GLuint triangleCount = (GLuint)(indexCount / 3);
+        if (triangleCount == 0) {
+            return;
+        }
+
+        BvhBuilder builder;
+        builder.boundsMin.resize(triangleCount);
+        builder.boundsMax.resize(triangleCount);
+        builder.centroids.resize(triangleCount);
+        builder.order.resize(triangleCount);
+        for (GLuint t = 0; t < triangleCount; t++) {
+            const glm::vec3& a = Position(positions, strideBytes, indices[3 * t]);
+            const glm::vec3& b = Position(positions, strideBytes, indices[3 * t + 1]);
+            const glm::vec3& c = Position(positions, strideBytes, indices[3 * t + 2]);
+            builder.boundsMin[t] = glm::min(a, glm::min(b, c));
+            builder.boundsMax[t] = glm::max(a, glm::max(b, c));
+            builder.centroids[t] = (builder.boundsMin[t] + builder.boundsMax[t]) * 0.5f;
+            builder.order[t] = t;
+        }
+
+        std::vector<BuildNode> top;
+        std::vector<BuildJob> jobs;
+        builder.BuildTop(0, triangleCount, top, jobs);
+
+        // the jobs work on disjoint runs of `order`, so they need no locking
+        if (jobs.size() == 1) {
+            builder.BuildRecursive(jobs[0].first, jobs[0].count, jobs[0].nodes);
+        } else {
+            std::vector<std::future<void> > pending;
+            for (size_t i = 0; i < jobs.size(); i++) {
+                BuildJob* job = &jobs[i];
+                BvhBuilder* shared = &builder;
+                pending.push_back(ThreadPool::GetShared().Submit([job, shared]() {
+                    shared->BuildRecursive(job->first, job->count, job->nodes);
+                }));
+            }
+            for (size_t i = 0; i < pending.size(); i++) {
+                pending[i].get();
+            }
+        }
+
+        BvhBuilder::Emit(top, 0, jobs, nodes);
+
+        std::vector<GLuint> original(indices, indices + (size_t)triangleCount * 3);
+        for (GLuint t = 0; t < triangleCount; t++) {
+            GLuint source = builder.order[t];
+            indices[3 * t] = original[3 * source];
+            indices[3 * t + 1] = original[3 * source + 1];
+            indices[3 * t + 2] = original[3 * source + 2];
+        }
+    }
+
+    void Bvh::Refit(const glm::vec3* positions, size_t strideBytes, const GLuint* indices)
+    {
+        // children come after their parent, so walking backwards sees them first
+        for (size_t i = nodes.size(); i-- > 0;) {
+            BvhNode& node = nodes[i];
+            if (node.rightChild == 0) {
+                node.min = glm::vec3(FLT_MAX);
+                node.max = glm::vec3(-FLT_MAX);
+                for (GLuint t = node.firstTriangle; t < node.firstTriangle + node.triangleCount; t++) {
+                    for (int corner = 0; corner < 3; corner++) {
+                        const glm::vec3& p = Position(positions, strideBytes, indices[3 * t + corner]);
+                        node.min = glm::min(node.min, p);
+                        node.max = glm::max(node.max, p);
+                    }
+                }
+            } else {
+                const BvhNode& left = nodes[i + 1];
+                const BvhNode& right = nodes[node.rightChild];
+                node.min = glm::min(left.min, right.min);
+                node.max = glm::max(left.max, right.max);
+            }
+        }
+    }
+
+    static BoxClass ClassifyBox(const Culling::Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 center = (min + max) * 0.5f;
+        glm::vec3 extent = (max - min) * 0.5f;
+        BoxClass result = BOX_INSIDE;
+        for (int p = 0; p < 6; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float reach = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+            if (distance + reach < 0.0f) {
+                return BOX_OUTSIDE;
+            }
+            if (distance - reach < 0.0f) {
+                result = BOX_INTERSECTING;
+            }
+        }
+        return result;
+    }
+
+    size_t Bvh::Cull(const Culling::Frustum& frustum, GLuint clusterTriangles, std::vector<TriangleRange>& ranges) const
+    {
+        size_t triangles = 0;
+        if (nodes.empty()) {
+            return 0;
+        }
+
+        GLuint stack[64];
+        int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0) {
+            const BvhNode& node = nodes[stack[--depth]];
+            BoxClass inside = ClassifyBox(frustum, node.min, node.max);
+            if (inside == BOX_OUTSIDE) {
+                continue;
+            }
+            // descend while the node is both large and only partly visible; a full
+            // stack also stops the descent, which only makes the result coarser
+            if (inside == BOX_INTERSECTING && node.rightChild != 0 && node.triangleCount > clusterTriangles && depth < 62) {
+                stack[depth++] = node.rightChild;
+                stack[depth++] = (GLuint)(&node - &nodes[0]) + 1;
+                continue;
+            }
+
+            if (!ranges.empty() && ranges.back().firstTriangle + ranges.back().triangleCount == node.firstTriangle) {
+                ranges.back().triangleCount += node.triangleCount;
+            } else {
+                TriangleRange range;
+                range.firstTriangle = node.firstTriangle;
+                range.triangleCount = node.triangleCount;
+                ranges.push_back(range);
+            }
+            triangles += node.triangleCount;
+        }
+        return triangles;
+    }
+
+    // Slab test; `entry` is where the ray enters the box
+    static bool IntersectBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const BvhNode& node,
+        float distance, float& entry)
+    {
+        glm::vec3 t1 = (node.min - origin) * inverseDirection;
+        glm::vec3 t2 = (node.max - origin) * inverseDirection;
+        glm::vec3 nearest = glm::min(t1, t2), farthest = glm::max(t1, t2);
+        entry = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.0f));
+        float exit = std::min(std::min(farthest.x, farthest.y), farthest.z);
+        return entry <= exit && entry < distance;
+    }
+
+    // Moller-Trumbore; returns the ray parameter of the hit or -1
+    static float IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction,
+        const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        glm::vec3 edge1 = b - a, edge2 = c - a;
+        glm::vec3 p = glm::cross(direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::fabs(determinant) < 1e-12f) {
+            return -1.0f;
+        }
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - a;
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f) {
+            return -1.0f;
+        }
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f) {
+            return -1.0f;
+        }
+        return glm::dot(edge2, q) * inverse;
+    }
+
+    bool Bvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3* positions, size_t strideBytes,
+        const GLuint* indices, float& distance) const
+    {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        glm::vec3 inverseDirection = 1.0f / direction;
+        bool hit = false;
+        GLuint stack[64];
+        int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0) {
+            GLuint index = stack[--depth];
+            const BvhNode& node = nodes[index];
+            float entry;
+            if (!IntersectBox(origin, inverseDirection, node, distance, entry)) {
+                continue;
+            }
+
+            if (node.rightChild == 0 || depth >= 62) {
+                for (GLuint t = node.firstTriangle; t < node.firstTriangle + node.triangleCount; t++) {
+                    float along = IntersectTriangle(origin, direction,
+                        Position(positions, strideBytes, indices[3 * t]),
+                        Position(positions, strideBytes, indices[3 * t + 1]),
+                        Position(positions, strideBytes, indices[3 * t + 2]));
+                    if (along > 0.0f && along < distance) {
+                        distance = along;
+                        hit = true;
+                    }
+                }
+                continue;
+            }
+
+            // visit the nearer child first so the farther one is usually rejected
+            GLuint left = index + 1, right = node.rightChild;
+            float leftEntry, rightEntry;
+            bool leftHit = IntersectBox(origin, inverseDirection, nodes[left], distance, leftEntry);
+            bool rightHit = IntersectBox(origin, inverseDirection, nodes[right], distance, rightEntry);
+            if (leftHit && rightHit) {
+                stack[depth++] = leftEntry < rightEntry ? right : left;
+                stack[depth++] = leftEntry < rightEntry ? left : right;
+            } else if (leftHit) {
+                stack[depth++] = left;
+            } else if (rightHit) {
+                stack[depth++] = right;
+            }
+        }
+        return hit;
+    }
+
+    const std::vector<BvhNode>& Bvh::GetNodes() const
+    {
+        return nodes;
+    }
+}
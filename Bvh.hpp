@@ -0,0 +1,65 @@
+#ifndef Bvh_hpp
+#define Bvh_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Culling.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Node of the flattened hierarchy, stored depth first: the left child
+    // always follows its parent, the right child is at rightChild.
+    struct BvhNode
+    {
+        glm::vec3 min;
+        GLuint firstTriangle;
+        glm::vec3 max;
+        GLuint triangleCount;
+        GLuint rightChild;  // 0 for leaves, the root is never a right child
+    };
+
+    // Run of consecutive triangles in the reordered index buffer
+    struct TriangleRange
+    {
+        GLuint firstTriangle;
+        GLuint triangleCount;
+    };
+
+    // Bounding volume hierarchy over the triangles of one mesh, in object
+    // space. Building reorders the triangles so that every node, not only the
+    // leaves, covers one contiguous run of the index buffer; culling can then
+    // draw a whole subtree with a single range.
+    class Bvh
+    {
+    public:
+        static const GLuint MAX_LEAF_TRIANGLES = 4;
+
+        // Binned SAH build; large meshes build their subtrees on the shared
+        // thread pool. Rewrites `indices` into the node order.
+        void Build(const glm::vec3* positions, size_t strideBytes, GLuint* indices, size_t indexCount);
+
+        // Recomputes the node bounds after vertex positions changed, keeping the topology
+        void Refit(const glm::vec3* positions, size_t strideBytes, const GLuint* indices);
+
+        // Appends the runs touching the frustum (given in object space). Nodes of up to
+        // clusterTriangles are taken whole instead of being descended into; adjacent runs
+        // are merged. Returns the number of triangles appended.
+        size_t Cull(const Culling::Frustum& frustum, GLuint clusterTriangles, std::vector<TriangleRange>& ranges) const;
+
+        // Closest hit along the ray (object space) that is nearer than `distance`;
+        // updates distance and returns true on a hit
+        bool Raycast(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3* positions, size_t strideBytes,
+            const GLuint* indices, float& distance) const;
+
+        const std::vector<BvhNode>& GetNodes() const;
+
+    private:
+        std::vector<BvhNode> nodes;
+    };
+}
+
+#endif /* Bvh_hpp */
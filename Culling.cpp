@@ -0,0 +1,182 @@
+#include "Culling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GPS_CULLING_SSE
+#include <emmintrin.h>
+#endif
+
+namespace gps {
+namespace Culling {
+
+    static CullStatistics statistics = { { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } };
+
+    Bounds ComputeBounds(const glm::vec3* positions, size_t count, size_t strideBytes)
+    {
+        Bounds bounds;
+        bounds.min = glm::vec3(0.0f);
+        bounds.max = glm::vec3(0.0f);
+        bounds.center = glm::vec3(0.0f);
+        bounds.radius = 0.0f;
+        if (count == 0) {
+            return bounds;
+        }
+
+        const unsigned char* bytes = (const unsigned char*)positions;
+        bounds.min = bounds.max = positions[0];
+        for (size_t i = 1; i < count; i++) {
+            const glm::vec3& p = *(const glm::vec3*)(bytes + i * strideBytes);
+            bounds.min = glm::min(bounds.min, p);
+            bounds.max = glm::max(bounds.max, p);
+        }
+
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 d = *(const glm::vec3*)(bytes + i * strideBytes) - bounds.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+        }
+        bounds.radius = std::sqrt(radiusSquared);
+        return bounds;
+    }
+
+    Frustum ExtractFrustum(const glm::mat4& m)
+    {
+        // glm is column major, row r is (m[0][r], m[1][r], m[2][r], m[3][r])
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0; // left
+        frustum.planes[1] = row3 - row0; // right
+        frustum.planes[2] = row3 + row1; // bottom
+        frustum.planes[3] = row3 - row1; // top
+        frustum.planes[4] = row3 + row2; // near
+        frustum.planes[5] = row3 - row2; // far
+        for (int i = 0; i < 6; i++) {
+            float length = glm::length(glm::vec3(frustum.planes[i]));
+            if (length > 0.0f) {
+                frustum.planes[i] /= length;
+            }
+        }
+        return frustum;
+    }
+
+    Frustum TransformFrustum(const Frustum& frustum, const glm::mat4& model)
+    {
+        // a point p is on the plane side n.(M p) + d >= 0, so the object-space plane is transpose(M) * plane
+        glm::mat4 transposed = glm::transpose(model);
+        Frustum result;
+        for (int i = 0; i < 6; i++) {
+            result.planes[i] = transposed * frustum.planes[i];
+            float length = glm::length(glm::vec3(result.planes[i]));
+            if (length > 0.0f) {
+                result.planes[i] /= length;
+            }
+        }
+        return result;
+    }
+
+    void TransformBounds(const Bounds* bounds, size_t count, const glm::mat4& model, WorldBounds& world)
+    {
+        size_t padded = (count + 3) & ~(size_t)3;
+        world.count = count;
+        world.centerX.assign(padded, 0.0f);
+        world.centerY.assign(padded, 0.0f);
+        world.centerZ.assign(padded, 0.0f);
+        world.extentX.assign(padded, 0.0f);
+        world.extentY.assign(padded, 0.0f);
+        world.extentZ.assign(padded, 0.0f);
+        world.radius.assign(padded, 0.0f);
+
+        glm::mat3 linear(model);
+        glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+        float scale = std::sqrt(std::max(glm::dot(linear[0], linear[0]),
+            std::max(glm::dot(linear[1], linear[1]), glm::dot(linear[2], linear[2]))));
+
+        for (size_t i = 0; i < count; i++) {
+            // ComputeBounds centers the sphere on the box, so one center serves both
+            glm::vec3 center = glm::vec3(model * glm::vec4(bounds[i].center, 1.0f));
+            glm::vec3 extent = absolute * ((bounds[i].max - bounds[i].min) * 0.5f);
+            world.centerX[i] = center.x;
+            world.centerY[i] = center.y;
+            world.centerZ[i] = center.z;
+            world.extentX[i] = extent.x;
+            world.extentY[i] = extent.y;
+            world.extentZ[i] = extent.z;
+            world.radius[i] = bounds[i].radius * scale;
+        }
+    }
+
+    size_t CullBounds(const Frustum& frustum, const WorldBounds& world, unsigned char* visible)
+    {
+        size_t visibleCount = 0;
+        size_t i = 0;
+
+#ifdef GPS_CULLING_SSE
+        for (; i < world.count; i += 4) {
+            __m128 cx = _mm_loadu_ps(&world.centerX[i]);
+            __m128 cy = _mm_loadu_ps(&world.centerY[i]);
+            __m128 cz = _mm_loadu_ps(&world.centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&world.extentX[i]);
+            __m128 ey = _mm_loadu_ps(&world.extentY[i]);
+            __m128 ez = _mm_loadu_ps(&world.extentZ[i]);
+            __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&world.radius[i]));
+            __m128 outside = _mm_setzero_ps();
+
+            for (int p = 0; p < 6; p++) {
+                const glm::vec4& plane = frustum.planes[p];
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+                // projected half size of the box onto the plane normal
+                __m128 reach = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(plane.x)), ex), _mm_mul_ps(_mm_set1_ps(std::fabs(plane.y)), ey)),
+                    _mm_mul_ps(_mm_set1_ps(std::fabs(plane.z)), ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            for (size_t lane = 0; lane < 4 && i + lane < world.count; lane++) {
+                visible[i + lane] = (mask >> lane) & 1 ? 0 : 1;
+                visibleCount += visible[i + lane];
+            }
+        }
+#endif
+
+        for (; i < world.count; i++) {
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++) {
+                const glm::vec4& plane = frustum.planes[p];
+                float distance = plane.x * world.centerX[i] + plane.y * world.centerY[i] + plane.z * world.centerZ[i] + plane.w;
+                float reach = std::fabs(plane.x) * world.extentX[i] + std::fabs(plane.y) * world.extentY[i]
+                    + std::fabs(plane.z) * world.extentZ[i];
+                outside = distance < -world.radius[i] || distance + reach < 0.0f;
+            }
+            visible[i] = outside ? 0 : 1;
+            visibleCount += visible[i];
+        }
+        return visibleCount;
+    }
+
+    void AddResults(int pass, size_t visible, size_t culled, size_t visibleTriangles, size_t culledTriangles,
+        size_t backfaceTriangles)
+    {
+        statistics.backfaceTriangles[pass] += backfaceTriangles;
+        statistics.visible[pass] += visible;
+        statistics.culled[pass] += culled;
+        statistics.visibleTriangles[pass] += visibleTriangles;
+        statistics.culledTriangles[pass] += culledTriangles;
+    }
+
+    CullStatistics GetStatistics()
+    {
+        return statistics;
+    }
+}
+}
@@ -0,0 +1,76 @@
+#ifndef Culling_hpp
+#define Culling_hpp
+
+#include <glm/glm.hpp>
+
+#include "ShadowCascades.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Object-space bounds of a mesh, filled in when the mesh is loaded
+    struct Bounds
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+        // sphere around the box center that encloses every vertex
+        glm::vec3 center;
+        float radius;
+    };
+
+    // View-frustum culling of mesh bounds. The test runs four meshes at a time
+    // with SSE on x86 and falls back to a scalar loop elsewhere.
+    namespace Culling {
+
+        // one per RenderPass: two per shadow cascade and the main pass
+        static const int PASS_COUNT = 2 * SHADOW_CASCADE_COUNT + 1;
+
+        // Planes as (normal, distance), normals pointing inside and normalized
+        struct Frustum
+        {
+            glm::vec4 planes[6];
+        };
+
+        // World-space bounds in structure-of-arrays form, padded to a multiple of four
+        struct WorldBounds
+        {
+            std::vector<float> centerX, centerY, centerZ;
+            std::vector<float> extentX, extentY, extentZ;
+            std::vector<float> radius;
+            size_t count;
+        };
+
+        // Meshes that survived and meshes that were culled per pass, since startup
+        struct CullStatistics
+        {
+            size_t visible[PASS_COUNT];
+            size_t culled[PASS_COUNT];
+            size_t visibleTriangles[PASS_COUNT];
+            size_t culledTriangles[PASS_COUNT];
+            size_t backfaceTriangles[PASS_COUNT];  // rejected by meshlet normal cones
+        };
+
+        Bounds ComputeBounds(const glm::vec3* positions, size_t count, size_t strideBytes);
+
+        // Gribb/Hartmann plane extraction from a projection * view (or light space) matrix
+        Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+        // Same frustum expressed in the object space of `model`
+        Frustum TransformFrustum(const Frustum& frustum, const glm::mat4& model);
+
+        // Moves the boxes and spheres to world space; boxes stay axis aligned and grow to
+        // enclose the rotated box, spheres scale with the largest axis scale of `model`
+        void TransformBounds(const Bounds* bounds, size_t count, const glm::mat4& model, WorldBounds& world);
+
+        // Writes 1 for every mesh whose sphere and box both touch the frustum, returns how many did
+        size_t CullBounds(const Frustum& frustum, const WorldBounds& world, unsigned char* visible);
+
+        void AddResults(int pass, size_t visible, size_t culled, size_t visibleTriangles, size_t culledTriangles,
+            size_t backfaceTriangles);
+        CullStatistics GetStatistics();
+    }
+}
+
+#endif /* Culling_hpp */
@@ -0,0 +1,157 @@
+#include "Dds.hpp"
+#include "MappedFile.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    static const unsigned int DDS_MAGIC = 0x20534444; // "DDS "
+    static const unsigned int FOURCC_DXT1 = 0x31545844;
+    static const unsigned int FOURCC_DXT5 = 0x35545844;
+
+    static const unsigned int DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+    static const unsigned int DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+    static const unsigned int DDPF_FOURCC = 0x4;
+    static const unsigned int DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+    // texconv's mark in the reserved header words: the tag, then the orientation flags
+    static const unsigned int GPS_TAG = 0x20535047; // "GPS "
+    static const unsigned int GPS_BOTTOM_UP = 0x1;
+
+    struct DdsPixelFormat
+    {
+        unsigned int size;
+        unsigned int flags;
+        unsigned int fourCC;
+        unsigned int rgbBitCount;
+        unsigned int masks[4];
+    };
+
+    struct DdsHeader
+    {
+        unsigned int size;
+        unsigned int flags;
+        unsigned int height;
+        unsigned int width;
+        unsigned int pitchOrLinearSize;
+        unsigned int depth;
+        unsigned int mipMapCount;
+        unsigned int reserved1[11];
+        DdsPixelFormat pixelFormat;
+        unsigned int caps;
+        unsigned int caps2;
+        unsigned int caps3;
+        unsigned int caps4;
+        unsigned int reserved2;
+    };
+
+    bool ReadDds(const std::string& fileName, DdsImage& image)
+    {
+        MappedFile file;
+        if (!file.Open(fileName)) {
+            return false;
+        }
+
+        DdsHeader header;
+        unsigned int magic;
+        if (file.GetSize() < sizeof(magic) + sizeof(header)) {
+            fprintf(stderr, "ERROR: %s is too small to be a DDS file\n", fileName.c_str());
+            return false;
+        }
+        memcpy(&magic, file.GetData(), sizeof(magic));
+        memcpy(&header, file.GetData() + sizeof(magic), sizeof(header));
+        if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader) || !(header.pixelFormat.flags & DDPF_FOURCC)) {
+            fprintf(stderr, "ERROR: %s is not a DDS file\n", fileName.c_str());
+            return false;
+        }
+        if (header.pixelFormat.fourCC == FOURCC_DXT1) {
+            image.format = BLOCK_BC1;
+        } else if (header.pixelFormat.fourCC == FOURCC_DXT5) {
+            image.format = BLOCK_BC3;
+        } else {
+            fprintf(stderr, "ERROR: %s is not DXT1 or DXT5 compressed\n", fileName.c_str());
+            return false;
+        }
+
+        image.width = (int)header.width;
+        image.height = (int)header.height;
+        image.bottomUp = header.reserved1[0] == GPS_TAG && (header.reserved1[1] & GPS_BOTTOM_UP) != 0;
+        unsigned int levelCount = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(1u, header.mipMapCount) : 1;
+
+        image.levels.clear();
+        size_t offset = sizeof(magic) + sizeof(header);
+        int width = image.width, height = image.height;
+        for (unsigned int level = 0; level < levelCount; level++) {
+            size_t levelSize = GetCompressedSize(image.format, width, height);
+            if (levelSize > file.GetSize() - offset) {
+                fprintf(stderr, "ERROR: %s is truncated\n", fileName.c_str());
+                return false;
+            }
+            const unsigned char* data = file.GetData() + offset;
+            image.levels.push_back(std::vector<unsigned char>(data, data + levelSize));
+            offset += levelSize;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return true;
+    }
+
+    bool WriteDds(const std::string& fileName, const DdsImage& image)
+    {
+        DdsHeader header;
+        memset(&header, 0, sizeof(header));
+        header.size = sizeof(DdsHeader);
+        header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+        header.height = (unsigned int)image.height;
+        header.width = (unsigned int)image.width;
+        header.pitchOrLinearSize = image.levels.empty() ? 0 : (unsigned int)image.levels[0].size();
+        header.mipMapCount = (unsigned int)image.levels.size();
+        header.reserved1[0] = GPS_TAG;
+        header.reserved1[1] = image.bottomUp ? GPS_BOTTOM_UP : 0;
+        header.pixelFormat.size = sizeof(DdsPixelFormat);
+        header.pixelFormat.flags = DDPF_FOURCC;
+        header.pixelFormat.fourCC = image.format == BLOCK_BC1 ? FOURCC_DXT1 : FOURCC_DXT5;
+        header.caps = DDSCAPS_TEXTURE | (image.levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+        std::ofstream file(fileName.c_str(), std::ios::binary);
+        if (!file) {
+            fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+            return false;
+        }
+        file.write((const char*)&DDS_MAGIC, sizeof(DDS_MAGIC));
+        file.write((const char*)&header, sizeof(header));
+        for (size_t i = 0; i < image.levels.size(); i++) {
+            file.write((const char*)&image.levels[i][0], image.levels[i].size());
+        }
+        return file.good();
+    }
+
+    std::string GetDdsPath(const std::string& imagePath)
+    {
+        size_t extension = imagePath.find_last_of('.');
+        size_t separator = imagePath.find_last_of("/\\");
+        if (extension == std::string::npos || (separator != std::string::npos && extension < separator)) {
+            return imagePath + ".dds";
+        }
+        return imagePath.substr(0, extension) + ".dds";
+    }
+
+    std::string FindDdsVariant(const std::string& imagePath)
+    {
+        std::string ddsPath = GetDdsPath(imagePath);
+        struct stat ddsInfo, imageInfo;
+        if (ddsPath == imagePath || stat(ddsPath.c_str(), &ddsInfo) != 0) {
+            return std::string();
+        }
+        // an image edited after the conversion wins over its stale .dds
+        if (stat(imagePath.c_str(), &imageInfo) == 0 && imageInfo.st_mtime > ddsInfo.st_mtime) {
+            return std::string();
+        }
+        return ddsPath;
+    }
+}
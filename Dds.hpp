@@ -0,0 +1,35 @@
+#ifndef Dds_hpp
+#define Dds_hpp
+
+#include "BlockCompression.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // A BC1 (DXT1) or BC3 (DXT5) 2D texture with its mip chain. texconv flips model
+    // textures the way the decoder would and records that in the header, so the
+    // loader can turn a file around when it was converted for the other orientation.
+    struct DdsImage
+    {
+        BlockFormat format;
+        int width;
+        int height;
+        // rows stored last to first, as GL uploads a flipped image; files from
+        // other tools are top-down
+        bool bottomUp;
+        std::vector<std::vector<unsigned char> > levels;
+    };
+
+    bool ReadDds(const std::string& fileName, DdsImage& image);
+    bool WriteDds(const std::string& fileName, const DdsImage& image);
+
+    // "dir/image.png" -> "dir/image.dds"
+    std::string GetDdsPath(const std::string& imagePath);
+
+    // The .dds converted from imagePath, or "" if there is none or the image is newer
+    std::string FindDdsVariant(const std::string& imagePath);
+}
+
+#endif /* Dds_hpp */
@@ -0,0 +1,124 @@
+#include "GLStateCache.hpp"
+
+namespace gps {
+
+    GLStateCache::GLStateCache()
+    {
+        statistics.issued = 0;
+        statistics.skipped = 0;
+        Invalidate();
+    }
+
+    GLStateCache& GLStateCache::GetInstance()
+    {
+        static GLStateCache instance;
+        return instance;
+    }
+
+    bool GLStateCache::Update(GLuint& current, GLuint value)
+    {
+        if (current == value) {
+            statistics.skipped++;
+            return false;
+        }
+        current = value;
+        statistics.issued++;
+        return true;
+    }
+
+    void GLStateCache::UseProgram(GLuint program)
+    {
+        if (Update(this->program, program)) {
+            glUseProgram(program);
+        }
+    }
+
+    void GLStateCache::BindVertexArray(GLuint vertexArray)
+    {
+        if (Update(this->vertexArray, vertexArray)) {
+            glBindVertexArray(vertexArray);
+        }
+    }
+
+    void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLuint* binding = NULL;
+        if (unit < MAX_TEXTURE_UNITS) {
+            if (target == GL_TEXTURE_2D) {
+                binding = &textures2D[unit];
+            } else if (target == GL_TEXTURE_CUBE_MAP) {
+                binding = &texturesCube[unit];
+            }
+        }
+
+        if (binding && *binding == texture) {
+            statistics.skipped++;
+            return;
+        }
+        if (Update(activeUnit, unit)) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+        }
+        glBindTexture(target, texture);
+        statistics.issued++;
+        if (binding) {
+            *binding = texture;
+        }
+    }
+
+    void GLStateCache::BindFramebuffer(GLuint framebuffer)
+    {
+        if (Update(this->framebuffer, framebuffer)) {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        }
+    }
+
+    void GLStateCache::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (viewportKnown && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+            statistics.skipped++;
+            return;
+        }
+        viewport[0] = x;
+        viewport[1] = y;
+        viewport[2] = width;
+        viewport[3] = height;
+        viewportKnown = true;
+        glViewport(x, y, width, height);
+        statistics.issued++;
+    }
+
+    void GLStateCache::DepthFunc(GLenum func)
+    {
+        if (Update(depthFunc, func)) {
+            glDepthFunc(func);
+        }
+    }
+
+    void GLStateCache::PolygonMode(GLenum mode)
+    {
+        // core profiles only accept GL_FRONT_AND_BACK
+        if (Update(polygonMode, mode)) {
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+        }
+    }
+
+    void GLStateCache::Invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (GLuint i = 0; i < MAX_TEXTURE_UNITS; i++) {
+            textures2D[i] = UNKNOWN;
+            texturesCube[i] = UNKNOWN;
+        }
+        framebuffer = UNKNOWN;
+        viewportKnown = false;
+        depthFunc = UNKNOWN;
+        polygonMode = UNKNOWN;
+    }
+
+    GLStateStatistics GLStateCache::GetStatistics() const
+    {
+        return statistics;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef GLStateCache_hpp
+#define GLStateCache_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+namespace gps {
+
+    // Calls issued to the driver versus calls dropped as redundant, since startup
+    struct GLStateStatistics
+    {
+        size_t issued;
+        size_t skipped;
+    };
+
+    // Shadows the bits of GL state the renderer changes every frame and drops
+    // calls that would set a value that is already current. Everything that
+    // changes this state inside the render loop has to go through the cache;
+    // setup code that bypasses it is followed by Invalidate().
+    class GLStateCache
+    {
+    public:
+        static GLStateCache& GetInstance();
+
+        void UseProgram(GLuint program);
+        void BindVertexArray(GLuint vertexArray);
+        // Makes unit active and binds texture to target there (2D and cube map targets are shadowed)
+        void BindTexture(GLuint unit, GLenum target, GLuint texture);
+        void BindFramebuffer(GLuint framebuffer);
+        void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+        void DepthFunc(GLenum func);
+        void PolygonMode(GLenum mode);
+
+        // Forgets the shadowed values, so the next call of each kind is issued
+        void Invalidate();
+
+        GLStateStatistics GetStatistics() const;
+
+    private:
+        static const GLuint MAX_TEXTURE_UNITS = 16;
+        static const GLuint UNKNOWN = 0xffffffff;
+
+        GLuint program;
+        GLuint vertexArray;
+        GLuint activeUnit;
+        GLuint textures2D[MAX_TEXTURE_UNITS];
+        GLuint texturesCube[MAX_TEXTURE_UNITS];
+        GLuint framebuffer;
+        GLint viewport[4];
+        bool viewportKnown;
+        GLenum depthFunc;
+        GLenum polygonMode;
+
+        GLStateStatistics statistics;
+
+        GLStateCache();
+
+        // Counts the call and tells whether it has to reach the driver
+        bool Update(GLuint& current, GLuint value);
+    };
+}
+
+#endif /* GLStateCache_hpp */
@@ -0,0 +1,169 @@
+#include "GeometryArena.hpp"
+#include "GLStateCache.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    static const size_t INITIAL_VERTEX_CAPACITY = 64 * 1024;
+    static const size_t INITIAL_INDEX_CAPACITY = 512 * 1024;  // bytes
+
+    // largest vertex count 16-bit indices can address
+    static const size_t MAX_SHORT_INDEX_VERTICES = 65536;
+
+    static size_t IndexSize(GLenum indexType)
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    }
+
+    GeometryArena::GeometryArena() : vertexArray(0), vertexBuffer(0), indexBuffer(0),
+        vertexCapacity(0), vertexCount(0), indexCapacity(0), indexBytes(0)
+    {
+        drawStatistics.drawCalls = 0;
+        drawStatistics.meshes = 0;
+    }
+
+    GeometryArena& GeometryArena::GetInstance()
+    {
+        static GeometryArena instance;
+        return instance;
+    }
+
+    void GeometryArena::Grow(GLuint& buffer, size_t usedBytes, size_t newBytes)
+    {
+        GLuint grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+        if (buffer) {
+            if (usedBytes > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &buffer);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        buffer = grown;
+    }
+
+    void GeometryArena::SetupVertexArray()
+    {
+        GLStateCache::GetInstance().BindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+        GpuVertexFormat::SetupAttributes();
+    }
+
+    bool GeometryArena::Reserve(size_t vertexCount, size_t indexBytes)
+    {
+        if (!vertexArray) {
+            glGenVertexArrays(1, &vertexArray);
+        }
+
+        bool grown = false;
+        if (this->vertexCount + vertexCount > vertexCapacity) {
+            size_t capacity = std::max(std::max(vertexCapacity * 2, INITIAL_VERTEX_CAPACITY), this->vertexCount + vertexCount);
+            Grow(vertexBuffer, this->vertexCount * sizeof(GpuVertex), capacity * sizeof(GpuVertex));
+            vertexCapacity = capacity;
+            grown = true;
+        }
+        if (this->indexBytes + indexBytes > indexCapacity) {
+            size_t capacity = std::max(std::max(indexCapacity * 2, INITIAL_INDEX_CAPACITY), this->indexBytes + indexBytes);
+            Grow(indexBuffer, this->indexBytes, capacity);
+            indexCapacity = capacity;
+            grown = true;
+        }
+        if (grown) {
+            SetupVertexArray();
+        }
+        return grown;
+    }
+
+    GeometryRange GeometryArena::Allocate(const GpuVertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount)
+    {
+        GeometryRange range;
+        range.baseVertex = (GLint)this->vertexCount;
+        range.indexCount = (GLsizei)indexCount;
+        range.indexType = vertexCount <= MAX_SHORT_INDEX_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        // room for the indices plus alignment, so AllocateIndices does not move the buffer again
+        Reserve(vertexCount, (indexCount + 1) * IndexSize(range.indexType));
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, this->vertexCount * sizeof(GpuVertex), vertexCount * sizeof(GpuVertex), vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        this->vertexCount += vertexCount;
+
+        range.firstIndex = AllocateIndices(indices, indexCount, range.indexType);
+        return range;
+    }
+
+    GLuint GeometryArena::AllocateIndices(const GLuint* indices, size_t indexCount, GLenum indexType)
+    {
+        // a list starts on a multiple of its own index size
+        size_t indexSize = IndexSize(indexType);
+        size_t offset = (this->indexBytes + indexSize - 1) / indexSize * indexSize;
+        Reserve(0, offset - this->indexBytes + indexCount * indexSize);
+
+        // the element buffer is VAO state, so go through the arena VAO
+        GLStateCache::GetInstance().BindVertexArray(vertexArray);
+        if (indexType == GL_UNSIGNED_SHORT) {
+            std::vector<GLushort> shortIndices(indices, indices + indexCount);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, indexCount * indexSize, shortIndices.data());
+        } else {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, indexCount * indexSize, indices);
+        }
+        this->indexBytes = offset + indexCount * indexSize;
+        return (GLuint)(offset / indexSize);
+    }
+
+    void GeometryArena::Bind()
+    {
+        GLStateCache::GetInstance().BindVertexArray(vertexArray);
+    }
+
+    void GeometryArena::Draw(const GeometryRange& range)
+    {
+        Bind();
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType,
+            (const GLvoid*)(range.firstIndex * IndexSize(range.indexType)), range.baseVertex);
+        drawStatistics.drawCalls++;
+        drawStatistics.meshes++;
+    }
+
+    void GeometryArena::MultiDraw(const MultiDrawBatch& batch)
+    {
+        if (batch.counts.empty()) {
+            return;
+        }
+        Bind();
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, &batch.counts[0], batch.indexType, (const GLvoid* const*)&batch.offsets[0],
+            (GLsizei)batch.counts.size(), (GLint*)&batch.baseVertices[0]);
+        drawStatistics.drawCalls++;
+        drawStatistics.meshes += batch.counts.size();
+    }
+
+    void GeometryArena::AddToBatch(const GeometryRange& range, MultiDrawBatch& batch)
+    {
+        batch.counts.push_back(range.indexCount);
+        batch.offsets.push_back((const GLvoid*)(range.firstIndex * IndexSize(range.indexType)));
+        batch.baseVertices.push_back(range.baseVertex);
+        batch.indexType = range.indexType;
+    }
+
+    size_t GeometryArena::GetVertexCount() const
+    {
+        return vertexCount;
+    }
+
+    size_t GeometryArena::GetIndexBytes() const
+    {
+        return indexBytes;
+    }
+
+    DrawStatistics GeometryArena::GetDrawStatistics() const
+    {
+        return drawStatistics;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#include <GL/glew.h>
+
+#include "VertexFormat.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Where a mesh lives inside the arena buffers
+    struct GeometryRange
+    {
+        GLint baseVertex;  // added to every index by the draw call
+        GLuint firstIndex; // counted in indexType elements
+        GLsizei indexCount;
+        GLenum indexType;  // GL_UNSIGNED_SHORT unless the mesh has more than 65536 vertices
+    };
+
+    // Ranges merged into one glMultiDrawElementsBaseVertex call, all of one index type
+    struct MultiDrawBatch
+    {
+        std::vector<GLsizei> counts;
+        std::vector<const GLvoid*> offsets;
+        std::vector<GLint> baseVertices;
+        GLenum indexType;
+    };
+
+    // Draw calls issued versus meshes they covered, since startup
+    struct DrawStatistics
+    {
+        size_t drawCalls;
+        size_t meshes;
+    };
+
+    // Sub-allocates every static mesh into one vertex buffer and one index
+    // buffer behind a single VAO, so meshes can be drawn without VAO switches
+    // and merged into multi-draw calls. Vertices are stored in GpuVertexFormat.
+    // Ranges are never freed; the buffers double in size when they run out.
+    class GeometryArena
+    {
+    public:
+        static GeometryArena& GetInstance();
+
+        // Stores the indices as 16-bit whenever the vertex count allows it
+        GeometryRange Allocate(const GpuVertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount);
+        // Appends indices only, for extra index lists over vertices already allocated
+        // (e.g. LODs), converted to indexType; returns the first index in that type
+        GLuint AllocateIndices(const GLuint* indices, size_t indexCount, GLenum indexType);
+
+        // Binds the arena VAO through the state cache
+        void Bind();
+
+        void Draw(const GeometryRange& range);
+        void MultiDraw(const MultiDrawBatch& batch);
+
+        // The range must have the index type of the ranges already in the batch
+        static void AddToBatch(const GeometryRange& range, MultiDrawBatch& batch);
+
+        size_t GetVertexCount() const;
+        size_t GetIndexBytes() const;
+        DrawStatistics GetDrawStatistics() const;
+
+    private:
+        GLuint vertexArray;
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        size_t vertexCapacity;
+        size_t vertexCount;
+        // 16 and 32-bit index lists share the index buffer, so it is measured in bytes
+        size_t indexCapacity;
+        size_t indexBytes;
+
+        DrawStatistics drawStatistics;
+
+        GeometryArena();
+
+        // Replaces buffer with a larger copy of its first usedBytes
+        static void Grow(GLuint& buffer, size_t usedBytes, size_t newBytes);
+        // Makes room for the given counts, returns whether a buffer moved
+        bool Reserve(size_t vertexCount, size_t indexBytes);
+        void SetupVertexArray();
+    };
+}
+
+#endif /* GeometryArena_hpp */
@@ -0,0 +1,398 @@
+#include "ImageOps.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GPS_IMAGE_OPS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define GPS_TARGET_AVX2
+#else
+#define GPS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef GPS_BENCHMARK_IMAGE_OPS
+#include <chrono>
+#include <iostream>
+#include <vector>
+#endif
+
+namespace gps {
+namespace ImageOps {
+
+    // ---- scalar ----
+
+    static void FlipRowsScalar(unsigned char* pixels, int width, int height, int channels)
+    {
+        size_t rowBytes = (size_t)width * channels;
+        for (int row = 0; row < height / 2; row++) {
+            unsigned char* top = pixels + row * rowBytes;
+            unsigned char* bottom = pixels + (height - row - 1) * rowBytes;
+            std::swap_ranges(top, top + rowBytes, bottom);
+        }
+    }
+
+    static void ExpandRGBToRGBAScalar(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount, unsigned char alpha)
+    {
+        for (size_t i = 0; i < pixelCount; i++) {
+            rgba[4 * i + 0] = rgb[3 * i + 0];
+            rgba[4 * i + 1] = rgb[3 * i + 1];
+            rgba[4 * i + 2] = rgb[3 * i + 2];
+            rgba[4 * i + 3] = alpha;
+        }
+    }
+
+    // round(value * alpha / 255) without a division
+    static inline unsigned char MultiplyAlpha(unsigned char value, unsigned char alpha)
+    {
+        unsigned int product = (unsigned int)value * alpha + 128;
+        return (unsigned char)((product + (product >> 8)) >> 8);
+    }
+
+    static void PremultiplyAlphaScalar(unsigned char* rgba, size_t pixelCount)
+    {
+        for (size_t i = 0; i < pixelCount; i++) {
+            unsigned char alpha = rgba[4 * i + 3];
+            rgba[4 * i + 0] = MultiplyAlpha(rgba[4 * i + 0], alpha);
+            rgba[4 * i + 1] = MultiplyAlpha(rgba[4 * i + 1], alpha);
+            rgba[4 * i + 2] = MultiplyAlpha(rgba[4 * i + 2], alpha);
+        }
+    }
+
+#ifdef GPS_IMAGE_OPS_X86
+
+    // ---- SSE2 (always present on x86-64) ----
+
+    static void SwapBytesSSE2(unsigned char* a, unsigned char* b, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+            _mm_storeu_si128((__m128i*)(a + i), vb);
+            _mm_storeu_si128((__m128i*)(b + i), va);
+        }
+        std::swap_ranges(a + i, a + count, b + i);
+    }
+
+    static void FlipRowsSSE2(unsigned char* pixels, int width, int height, int channels)
+    {
+        size_t rowBytes = (size_t)width * channels;
+        for (int row = 0; row < height / 2; row++) {
+            SwapBytesSSE2(pixels + row * rowBytes, pixels + (height - row - 1) * rowBytes, rowBytes);
+        }
+    }
+
+    // Premultiplies the pixels in 16-bit lanes [r g b a r g b a]
+    static inline __m128i PremultiplyLanesSSE2(__m128i lanes)
+    {
+        const __m128i colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+        const __m128i alphaOne = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+        const __m128i half = _mm_set1_epi16(128);
+
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lanes, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        alpha = _mm_or_si128(_mm_and_si128(alpha, colorMask), alphaOne);
+
+        __m128i product = _mm_add_epi16(_mm_mullo_epi16(lanes, alpha), half);
+        return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+    }
+
+    static void PremultiplyAlphaSSE2(unsigned char* rgba, size_t pixelCount)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 4 <= pixelCount; i += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(rgba + 4 * i));
+            __m128i low = PremultiplyLanesSSE2(_mm_unpacklo_epi8(pixels, zero));
+            __m128i high = PremultiplyLanesSSE2(_mm_unpackhi_epi8(pixels, zero));
+            _mm_storeu_si128((__m128i*)(rgba + 4 * i), _mm_packus_epi16(low, high));
+        }
+        PremultiplyAlphaScalar(rgba + 4 * i, pixelCount - i);
+    }
+
+    // ---- AVX2 ----
+
+    GPS_TARGET_AVX2
+    static void SwapBytesAVX2(unsigned char* a, unsigned char* b, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+            _mm256_storeu_si256((__m256i*)(a + i), vb);
+            _mm256_storeu_si256((__m256i*)(b + i), va);
+        }
+        std::swap_ranges(a + i, a + count, b + i);
+    }
+
+    GPS_TARGET_AVX2
+    static void FlipRowsAVX2(unsigned char* pixels, int width, int height, int channels)
+    {
+        size_t rowBytes = (size_t)width * channels;
+        for (int row = 0; row < height / 2; row++) {
+            SwapBytesAVX2(pixels + row * rowBytes, pixels + (height - row - 1) * rowBytes, rowBytes);
+        }
+    }
+
+    GPS_TARGET_AVX2
+    static void ExpandRGBToRGBAAVX2(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount, unsigned char alpha)
+    {
+        // 4 pixels per shuffle; the 16-byte loads read 4 bytes past the 12 they use
+        const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alphaBytes = _mm_set1_epi32((int)((unsigned int)alpha << 24));
+        size_t i = 0;
+        for (; i + 18 <= pixelCount; i += 16) {
+            const unsigned char* source = rgb + 3 * i;
+            __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 0)), spread);
+            __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 12)), spread);
+            __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 24)), spread);
+            __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 36)), spread);
+            __m256i ab = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_or_si128(a, alphaBytes)), _mm_or_si128(b, alphaBytes), 1);
+            __m256i cd = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_or_si128(c, alphaBytes)), _mm_or_si128(d, alphaBytes), 1);
+            _mm256_storeu_si256((__m256i*)(rgba + 4 * i), ab);
+            _mm256_storeu_si256((__m256i*)(rgba + 4 * i + 32), cd);
+        }
+        ExpandRGBToRGBAScalar(rgb + 3 * i, rgba + 4 * i, pixelCount - i, alpha);
+    }
+
+    GPS_TARGET_AVX2
+    static inline __m256i PremultiplyLanesAVX2(__m256i lanes)
+    {
+        const __m256i colorMask = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+        const __m256i alphaOne = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+        const __m256i half = _mm256_set1_epi16(128);
+
+        __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lanes, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        alpha = _mm256_or_si256(_mm256_and_si256(alpha, colorMask), alphaOne);
+
+        __m256i product = _mm256_add_epi16(_mm256_mullo_epi16(lanes, alpha), half);
+        return _mm256_srli_epi16(_mm256_add_epi16(product, _mm256_srli_epi16(product, 8)), 8);
+    }
+
+    GPS_TARGET_AVX2
+    static void PremultiplyAlphaAVX2(unsigned char* rgba, size_t pixelCount)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= pixelCount; i += 8) {
+            // unpack and pack both work per 128-bit lane, so the pixel order survives
+            __m256i pixels = _mm256_loadu_si256((const __m256i*)(rgba + 4 * i));
+            __m256i low = PremultiplyLanesAVX2(_mm256_unpacklo_epi8(pixels, zero));
+            __m256i high = PremultiplyLanesAVX2(_mm256_unpackhi_epi8(pixels, zero));
+            _mm256_storeu_si256((__m256i*)(rgba + 4 * i), _mm256_packus_epi16(low, high));
+        }
+        PremultiplyAlphaScalar(rgba + 4 * i, pixelCount - i);
+    }
+
+    static bool CpuSupportsAVX2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        return osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }
+
+#endif
+
+    // ---- dispatch ----
+
+    struct Dispatch
+    {
+        const char* name;
+        void (*flipRows)(unsigned char*, int, int, int);
+        void (*expandRGBToRGBA)(const unsigned char*, unsigned char*, size_t, unsigned char);
+        void (*premultiplyAlpha)(unsigned char*, size_t);
+    };
+
+    static Dispatch SelectDispatch()
+    {
+        Dispatch dispatch = { "scalar", FlipRowsScalar, ExpandRGBToRGBAScalar, PremultiplyAlphaScalar };
+#ifdef GPS_IMAGE_OPS_X86
+        if (CpuSupportsAVX2()) {
+            dispatch.name = "AVX2";
+            dispatch.flipRows = FlipRowsAVX2;
+            dispatch.expandRGBToRGBA = ExpandRGBToRGBAAVX2;
+            dispatch.premultiplyAlpha = PremultiplyAlphaAVX2;
+        } else {
+            // SSE2 has no byte shuffle, so the RGB expansion stays scalar there
+            dispatch.name = "SSE2";
+            dispatch.flipRows = FlipRowsSSE2;
+            dispatch.premultiplyAlpha = PremultiplyAlphaSSE2;
+        }
+#endif
+        return dispatch;
+    }
+
+    static const Dispatch& GetDispatch()
+    {
+        static const Dispatch dispatch = SelectDispatch();
+        return dispatch;
+    }
+
+    const char* GetInstructionSet()
+    {
+        return GetDispatch().name;
+    }
+
+    void FlipRows(unsigned char* pixels, int width, int height, int channels)
+    {
+        GetDispatch().flipRows(pixels, width, height, channels);
+    }
+
+    void ExpandRGBToRGBA(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount, unsigned char alpha)
+    {
+        GetDispatch().expandRGBToRGBA(rgb, rgba, pixelCount, alpha);
+    }
+
+    void PremultiplyAlpha(unsigned char* rgba, size_t pixelCount)
+    {
+        GetDispatch().premultiplyAlpha(rgba, pixelCount);
+    }
+
+    // ---- sRGB ----
+
+    static const int LINEAR_TO_SRGB_STEPS = 4096;
+
+    struct SRGBTables
+    {
+        float toLinear[256];
+        unsigned char fromLinear[LINEAR_TO_SRGB_STEPS + 1];
+
+        SRGBTables()
+        {
+            for (int i = 0; i < 256; i++) {
+                float c = i / 255.0f;
+                toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            for (int i = 0; i <= LINEAR_TO_SRGB_STEPS; i++) {
+                float l = (float)i / LINEAR_TO_SRGB_STEPS;
+                float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                fromLinear[i] = (unsigned char)(c * 255.0f + 0.5f);
+            }
+        }
+    };
+
+    static const SRGBTables& GetSRGBTables()
+    {
+        static const SRGBTables tables;
+        return tables;
+    }
+
+    float SRGBToLinear(unsigned char value)
+    {
+        return GetSRGBTables().toLinear[value];
+    }
+
+    unsigned char LinearToSRGB(float value)
+    {
+        value = std::min(std::max(value, 0.0f), 1.0f);
+        return GetSRGBTables().fromLinear[(int)(value * LINEAR_TO_SRGB_STEPS + 0.5f)];
+    }
+
+    void Downsample(const unsigned char* source, int width, int height, int channels, bool srgb,
+        unsigned char* destination)
+    {
+        const SRGBTables& tables = GetSRGBTables();
+        int halfWidth = std::max(1, width / 2);
+        int halfHeight = std::max(1, height / 2);
+        int alphaChannel = (channels == 2 || channels == 4) ? channels - 1 : -1;
+
+        for (int y = 0; y < halfHeight; y++) {
+            const unsigned char* row0 = source + (size_t)std::min(2 * y, height - 1) * width * channels;
+            const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * channels;
+            unsigned char* output = destination + (size_t)y * halfWidth * channels;
+            for (int x = 0; x < halfWidth; x++) {
+                int x0 = std::min(2 * x, width - 1) * channels;
+                int x1 = std::min(2 * x + 1, width - 1) * channels;
+                for (int c = 0; c < channels; c++) {
+                    if (srgb && c != alphaChannel) {
+                        float sum = tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]] +
+                            tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+                        output[x * channels + c] = tables.fromLinear[(int)(sum * (LINEAR_TO_SRGB_STEPS / 4.0f) + 0.5f)];
+                    } else {
+                        output[x * channels + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                    }
+                }
+            }
+        }
+    }
+
+#ifdef GPS_BENCHMARK_IMAGE_OPS
+
+    template <typename Function>
+    static double TimeMilliseconds(Function function)
+    {
+        // best of a few runs, to keep page faults and frequency ramps out of the numbers
+        double best = 1e30;
+        for (int run = 0; run < 5; run++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            function();
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    void RunBenchmark()
+    {
+        const int width = 4096, height = 4096;
+        const size_t pixelCount = (size_t)width * height;
+        std::vector<unsigned char> rgba(pixelCount * 4), rgb(pixelCount * 3), expanded(pixelCount * 4);
+        for (size_t i = 0; i < rgba.size(); i++) {
+            rgba[i] = (unsigned char)(i * 2654435761u >> 13);
+        }
+        for (size_t i = 0; i < rgb.size(); i++) {
+            rgb[i] = rgba[i];
+        }
+
+        // the loop ReadTextureFromFile used before this module
+        double byteLoop = TimeMilliseconds([&]() {
+            int width_in_bytes = width * 4;
+            for (int row = 0; row < height / 2; row++) {
+                unsigned char* top = &rgba[0] + row * width_in_bytes;
+                unsigned char* bottom = &rgba[0] + (height - row - 1) * width_in_bytes;
+                for (int col = 0; col < width_in_bytes; col++) {
+                    unsigned char temp = *top;
+                    *top = *bottom;
+                    *bottom = temp;
+                    top++;
+                    bottom++;
+                }
+            }
+        });
+        double flipScalar = TimeMilliseconds([&]() { FlipRowsScalar(&rgba[0], width, height, 4); });
+        double flip = TimeMilliseconds([&]() { FlipRows(&rgba[0], width, height, 4); });
+
+        double expandScalar = TimeMilliseconds([&]() { ExpandRGBToRGBAScalar(&rgb[0], &expanded[0], pixelCount, 255); });
+        double expand = TimeMilliseconds([&]() { ExpandRGBToRGBA(&rgb[0], &expanded[0], pixelCount); });
+
+        // premultiplying is not idempotent, so each run starts from a fresh copy
+        std::vector<unsigned char> copy;
+        double premultiplyScalar = TimeMilliseconds([&]() { copy = rgba; PremultiplyAlphaScalar(&copy[0], pixelCount); });
+        std::vector<unsigned char> reference = copy;
+        double premultiply = TimeMilliseconds([&]() { copy = rgba; PremultiplyAlpha(&copy[0], pixelCount); });
+        bool premultiplyMatches = copy == reference;
+
+        std::cout << "Image ops      : " << GetInstructionSet() << ", " << width << "x" << height << " RGBA" << std::endl;
+        std::cout << "Flip rows      : byte loop " << byteLoop << " ms, scalar " << flipScalar << " ms, dispatched " << flip << " ms" << std::endl;
+        std::cout << "RGB to RGBA    : scalar " << expandScalar << " ms, dispatched " << expand << " ms" << std::endl;
+        std::cout << "Premultiply    : scalar " << premultiplyScalar << " ms, dispatched " << premultiply << " ms"
+            << (premultiplyMatches ? "" : " (MISMATCH)") << std::endl;
+    }
+
+#endif
+}
+}
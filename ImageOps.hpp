@@ -0,0 +1,39 @@
+#ifndef ImageOps_hpp
+#define ImageOps_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    // Pixel operations on 8-bit images. Each one has a scalar version and, on
+    // x86, SSE2/AVX2 versions picked once at runtime from the CPU features.
+    namespace ImageOps {
+
+        // Name of the instruction set the dispatcher picked ("AVX2", "SSE2" or "scalar")
+        const char* GetInstructionSet();
+
+        // Mirrors the image vertically in place by swapping whole rows
+        void FlipRows(unsigned char* pixels, int width, int height, int channels);
+
+        // Expands tightly packed RGB to RGBA with a constant alpha
+        void ExpandRGBToRGBA(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount, unsigned char alpha = 255);
+
+        // Multiplies the color channels of RGBA pixels by their alpha, rounding to nearest
+        void PremultiplyAlpha(unsigned char* rgba, size_t pixelCount);
+
+        float SRGBToLinear(unsigned char value);
+        unsigned char LinearToSRGB(float value);
+
+        // Halves an image with a 2x2 box filter. With `srgb` the color channels are
+        // averaged in linear space; the fourth channel is always treated as linear.
+        void Downsample(const unsigned char* source, int width, int height, int channels, bool srgb,
+            unsigned char* destination);
+
+#ifdef GPS_BENCHMARK_IMAGE_OPS
+        // Times the operations above against the byte-by-byte loops they replaced
+        void RunBenchmark();
+#endif
+    }
+}
+
+#endif /* ImageOps_hpp */
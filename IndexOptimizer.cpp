@@ -0,0 +1,350 @@
+#include "IndexOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace gps {
+
+    // Forsyth's scoring constants; the scoring cache is larger than the FIFO that is
+    // measured, as recommended, so the order degrades gracefully on larger caches
+    static const int SCORE_CACHE_SIZE = 32;
+    static const float CACHE_DECAY_POWER = 1.5f;
+    static const float LAST_TRIANGLE_SCORE = 0.75f;
+    static const float VALENCE_BOOST_SCALE = 2.0f;
+    static const float VALENCE_BOOST_POWER = 0.5f;
+    static const int MAX_VALENCE_SCORE = 32;
+
+    // a piece of the overdraw order may have an ACMR this much worse than its whole hard cluster
+    static const float OVERDRAW_ACMR_THRESHOLD = 1.05f;
+
+    static inline const glm::vec3& Position(const glm::vec3* positions, size_t strideBytes, GLuint vertex)
+    {
+        return *(const glm::vec3*)((const unsigned char*)positions + vertex * strideBytes);
+    }
+
+    // FIFO cache simulation by timestamps: a vertex is cached while fewer than cacheSize
+    // misses happened since it was loaded
+    class FifoCache
+    {
+    public:
+        FifoCache(size_t vertexCount, size_t cacheSize)
+            : loadedAt(vertexCount, 0), cacheSize(cacheSize), time(cacheSize + 1)
+        {
+        }
+
+        // returns 1 when v had to be transformed
+        unsigned int Access(GLuint v) {
+            if (time - loadedAt[v] <= cacheSize) {
+                return 0;
+            }
+            loadedAt[v] = ++time;
+            return 1;
+        }
+
+        void Clear() {
+            time += cacheSize + 1;
+        }
+
+    private:
+        std::vector<size_t> loadedAt;
+        size_t cacheSize;
+        size_t time;
+    };
+
+    static size_t VertexLimit(const GLuint* indices, size_t indexCount)
+    {
+        GLuint limit = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            limit = std::max(limit, indices[i] + 1);
+        }
+        return limit;
+    }
+
+    VertexCacheStatistics AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t cacheSize)
+    {
+        VertexCacheStatistics statistics;
+        statistics.triangles = indexCount / 3;
+        statistics.vertices = 0;
+        statistics.misses = 0;
+
+        size_t vertexLimit = VertexLimit(indices, indexCount);
+        std::vector<unsigned char> seen(vertexLimit, 0);
+        FifoCache cache(vertexLimit, cacheSize);
+        for (size_t i = 0; i < statistics.triangles * 3; i++) {
+            statistics.misses += cache.Access(indices[i]);
+            if (!seen[indices[i]]) {
+                seen[indices[i]] = 1;
+                statistics.vertices++;
+            }
+        }
+        return statistics;
+    }
+
+    static float CacheScore(int position)
+    {
+        if (position < 0) {
+            return 0.0f;
+        }
+        // the last triangle's vertices score the same whatever their order, so a
+        // strip-like zigzag is not preferred over a fan
+        if (position < 3) {
+            return LAST_TRIANGLE_SCORE;
+        }
+        float scale = 1.0f / (SCORE_CACHE_SIZE - 3);
+        return std::pow(1.0f - (position - 3) * scale, CACHE_DECAY_POWER);
+    }
+
+    static float ValenceScore(unsigned int liveTriangles)
+    {
+        // vertices with few triangles left are finished first, so they leave no holes behind
+        return VALENCE_BOOST_SCALE * std::pow((float)liveTriangles, -VALENCE_BOOST_POWER);
+    }
+
+    void OptimizeVertexCache(GLuint* indices, size_t indexCount)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2) {
+            return;
+        }
+
+        // local vertex numbers, so a small range of a large mesh stays cheap
+        std::vector<GLuint> unique(indices, indices + triangleCount * 3);
+        std::sort(unique.begin(), unique.end());
+        unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+        size_t vertexCount = unique.size();
+        std::vector<GLuint> local(triangleCount * 3);
+        for (size_t i = 0; i < local.size(); i++) {
+            local[i] = (GLuint)(std::lower_bound(unique.begin(), unique.end(), indices[i]) - unique.begin());
+        }
+
+        // triangles around each vertex; the first liveTriangles[v] entries are not emitted yet
+        std::vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (size_t i = 0; i < local.size(); i++) {
+            liveTriangles[local[i]]++;
+        }
+        std::vector<size_t> adjacencyStart(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+        }
+        std::vector<GLuint> adjacency(local.size());
+        std::vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t i = 0; i < local.size(); i++) {
+            adjacency[fill[local[i]]++] = (GLuint)(i / 3);
+        }
+
+        float cacheScores[SCORE_CACHE_SIZE];
+        for (int p = 0; p < SCORE_CACHE_SIZE; p++) {
+            cacheScores[p] = CacheScore(p);
+        }
+        float valenceScores[MAX_VALENCE_SCORE + 1];
+        valenceScores[0] = 0.0f;
+        for (int n = 1; n <= MAX_VALENCE_SCORE; n++) {
+            valenceScores[n] = ValenceScore(n);
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) {
+            vertexScores[v] = valenceScores[std::min(liveTriangles[v], (unsigned int)MAX_VALENCE_SCORE)];
+        }
+        std::vector<float> triangleScores(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            triangleScores[t] = vertexScores[local[3 * t]] + vertexScores[local[3 * t + 1]] + vertexScores[local[3 * t + 2]];
+        }
+
+        std::vector<unsigned char> emitted(triangleCount, 0);
+        GLuint cache[SCORE_CACHE_SIZE + 3];
+        GLuint nextCache[SCORE_CACHE_SIZE + 3];
+        int cacheCount = 0;
+        size_t cursor = 0;
+        long bestTriangle = -1;
+
+        for (size_t output = 0; output < triangleCount; output++) {
+            if (bestTriangle < 0) {
+                // nothing in the cache has triangles left: continue at the next one in input order
+                while (emitted[cursor]) {
+                    cursor++;
+                }
+                bestTriangle = (long)cursor;
+            }
+
+            GLuint t = (GLuint)bestTriangle;
+            emitted[t] = 1;
+            const GLuint* corners = &local[3 * t];
+            for (int c = 0; c < 3; c++) {
+                indices[3 * output + c] = unique[corners[c]];
+
+                // swap the triangle out of the live part of the vertex's list
+                GLuint v = corners[c];
+                GLuint* begin = &adjacency[adjacencyStart[v]];
+                GLuint* last = begin + --liveTriangles[v];
+                *std::find(begin, last + 1, t) = *last;
+                *last = t;
+            }
+
+            // the triangle's vertices move to the front, the rest shift back
+            int nextCount = 0;
+            for (int c = 0; c < 3; c++) {
+                nextCache[nextCount++] = corners[c];
+            }
+            for (int i = 0; i < cacheCount; i++) {
+                GLuint v = cache[i];
+                if (v != corners[0] && v != corners[1] && v != corners[2]) {
+                    nextCache[nextCount++] = v;
+                }
+            }
+            cacheCount = std::min(nextCount, SCORE_CACHE_SIZE);
+            for (int i = cacheCount; i < nextCount; i++) {
+                cachePosition[nextCache[i]] = -1;
+            }
+
+            // rescore what is cached and what just fell out, keeping the best live triangle
+            bestTriangle = -1;
+            float bestScore = 0.0f;
+            for (int i = 0; i < nextCount; i++) {
+                GLuint v = nextCache[i];
+                int position = i < cacheCount ? i : -1;
+                if (i < cacheCount) {
+                    cache[i] = v;
+                }
+                cachePosition[v] = position;
+                float score = liveTriangles[v] == 0 ? -1.0f
+                    : (position >= 0 ? cacheScores[position] : 0.0f)
+                    + valenceScores[std::min(liveTriangles[v], (unsigned int)MAX_VALENCE_SCORE)];
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+
+                const GLuint* triangles = &adjacency[adjacencyStart[v]];
+                for (unsigned int j = 0; j < liveTriangles[v]; j++) {
+                    GLuint other = triangles[j];
+                    triangleScores[other] += delta;
+                    if (position >= 0 && triangleScores[other] > bestScore) {
+                        bestScore = triangleScores[other];
+                        bestTriangle = other;
+                    }
+                }
+            }
+        }
+    }
+
+    struct Cluster
+    {
+        size_t firstTriangle;
+        size_t triangleCount;
+        float sortKey;
+    };
+
+    static bool FacesOutwardMore(const Cluster& a, const Cluster& b)
+    {
+        return a.sortKey > b.sortKey;
+    }
+
+    void OptimizeOverdraw(GLuint* indices, size_t indexCount, const glm::vec3* positions, size_t strideBytes,
+        const glm::vec3& center)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2) {
+            return;
+        }
+
+        size_t vertexLimit = VertexLimit(indices, triangleCount * 3);
+        FifoCache cache(vertexLimit, VERTEX_CACHE_SIZE);
+
+        // hard boundaries: triangles that miss on all three vertices start the cache over,
+        // so moving what follows them costs nothing
+        std::vector<size_t> hardStarts;
+        for (size_t t = 0; t < triangleCount; t++) {
+            unsigned int misses = cache.Access(indices[3 * t]) + cache.Access(indices[3 * t + 1]) + cache.Access(indices[3 * t + 2]);
+            if (t == 0 || misses == 3) {
+                hardStarts.push_back(t);
+            }
+        }
+        hardStarts.push_back(triangleCount);
+
+        // soft boundaries: inside a hard cluster, cut wherever the piece so far is
+        // nearly as cache friendly as the whole cluster
+        std::vector<Cluster> clusters;
+        for (size_t h = 0; h + 1 < hardStarts.size(); h++) {
+            size_t begin = hardStarts[h], end = hardStarts[h + 1];
+            cache.Clear();
+            size_t clusterMisses = 0;
+            for (size_t i = 3 * begin; i < 3 * end; i++) {
+                clusterMisses += cache.Access(indices[i]);
+            }
+            float threshold = OVERDRAW_ACMR_THRESHOLD * clusterMisses / (end - begin);
+
+            cache.Clear();
+            Cluster cluster;
+            cluster.firstTriangle = begin;
+            size_t misses = 0;
+            for (size_t t = begin; t < end; t++) {
+                misses += cache.Access(indices[3 * t]) + cache.Access(indices[3 * t + 1]) + cache.Access(indices[3 * t + 2]);
+                size_t count = t + 1 - cluster.firstTriangle;
+                if (t + 1 == end || misses <= threshold * count) {
+                    cluster.triangleCount = count;
+                    clusters.push_back(cluster);
+                    cluster.firstTriangle = t + 1;
+                    misses = 0;
+                    cache.Clear();
+                }
+            }
+        }
+        if (clusters.size() < 2) {
+            return;
+        }
+
+        // clusters far out along their own normal tend to occlude the rest, so draw them first
+        for (size_t c = 0; c < clusters.size(); c++) {
+            glm::vec3 centroid(0.0f);
+            glm::vec3 normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].triangleCount; t++) {
+                const glm::vec3& a = Position(positions, strideBytes, indices[3 * t]);
+                const glm::vec3& b = Position(positions, strideBytes, indices[3 * t + 1]);
+                const glm::vec3& c2 = Position(positions, strideBytes, indices[3 * t + 2]);
+                glm::vec3 cross = glm::cross(b - a, c2 - a);
+                float triangleArea = glm::length(cross);
+                centroid += (a + b + c2) * (triangleArea / 3.0f);
+                normal += cross;
+                area += triangleArea;
+            }
+            float normalLength = glm::length(normal);
+            clusters[c].sortKey = area > 0.0f && normalLength > 0.0f
+                ? glm::dot(centroid / area - center, normal / normalLength) : 0.0f;
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), FacesOutwardMore);
+
+        std::vector<GLuint> source(indices, indices + triangleCount * 3);
+        size_t output = 0;
+        for (size_t c = 0; c < clusters.size(); c++) {
+            size_t count = clusters[c].triangleCount * 3;
+            memcpy(&indices[output], &source[clusters[c].firstTriangle * 3], count * sizeof(GLuint));
+            output += count;
+        }
+    }
+
+    void OptimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize, GLuint* indices, size_t indexCount)
+    {
+        const GLuint unused = ~0u;
+        std::vector<GLuint> remap(vertexCount, unused);
+        GLuint next = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            if (remap[indices[i]] == unused) {
+                remap[indices[i]] = next++;
+            }
+            indices[i] = remap[indices[i]];
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            if (remap[v] == unused) {
+                remap[v] = next++;
+            }
+        }
+
+        std::vector<unsigned char> source((unsigned char*)vertices, (unsigned char*)vertices + vertexCount * vertexSize);
+        for (size_t v = 0; v < vertexCount; v++) {
+            memcpy((unsigned char*)vertices + remap[v] * vertexSize, &source[v * vertexSize], vertexSize);
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef IndexOptimizer_hpp
+#define IndexOptimizer_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+namespace gps {
+
+    // Post-transform cache behaviour of an index list on a FIFO cache. Counts rather
+    // than ratios, so the results of several meshes can be added up.
+    struct VertexCacheStatistics
+    {
+        size_t triangles;
+        size_t vertices;   // distinct vertices referenced
+        size_t misses;     // vertex shader invocations
+
+        // average cache miss ratio, 0.5 is the best a large regular mesh can get
+        float GetACMR() const { return triangles ? (float)misses / triangles : 0.0f; }
+        // average transformed vertex ratio, 1 means every vertex is shaded once
+        float GetATVR() const { return vertices ? (float)misses / vertices : 0.0f; }
+    };
+
+    static const size_t VERTEX_CACHE_SIZE = 16;
+
+    VertexCacheStatistics AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t cacheSize = VERTEX_CACHE_SIZE);
+
+    // Reorders the triangles for vertex cache locality (Forsyth's linear-speed
+    // optimisation). Works on any subrange of an index buffer.
+    void OptimizeVertexCache(GLuint* indices, size_t indexCount);
+
+    // Reorders cache-optimized triangles against overdraw without a view point: the
+    // list is cut where the cache starts over and the pieces are sorted so those
+    // facing away from `center` come first (Sander et al., "Fast Triangle Reordering")
+    void OptimizeOverdraw(GLuint* indices, size_t indexCount, const glm::vec3* positions, size_t strideBytes,
+        const glm::vec3& center);
+
+    // Renumbers the vertices in order of first use so fetches walk the vertex buffer
+    // forward; vertices no index refers to move to the end
+    void OptimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize, GLuint* indices, size_t indexCount);
+}
+
+#endif /* IndexOptimizer_hpp */
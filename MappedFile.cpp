@@ -0,0 +1,116 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+    MappedFile::MappedFile() : data(NULL), size(0)
+#ifdef _WIN32
+        , fileHandle(NULL), mappingHandle(NULL)
+#endif
+    {
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    bool MappedFile::Open(const std::string& fileName)
+    {
+        Close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL) {
+            CloseHandle(file);
+            return false;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == NULL) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        this->fileHandle = file;
+        this->mappingHandle = mapping;
+        this->data = (const unsigned char*)view;
+        this->size = (size_t)fileSize.QuadPart;
+#else
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat fileInfo;
+        if (fstat(fd, &fileInfo) != 0 || fileInfo.st_size == 0) {
+            close(fd);
+            return false;
+        }
+
+        void* view = mmap(NULL, (size_t)fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping stays valid after the descriptor is closed
+        close(fd);
+        if (view == MAP_FAILED) {
+            return false;
+        }
+
+        this->data = (const unsigned char*)view;
+        this->size = (size_t)fileInfo.st_size;
+#endif
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (this->data == NULL) {
+            return;
+        }
+
+#ifdef _WIN32
+        UnmapViewOfFile(this->data);
+        CloseHandle((HANDLE)this->mappingHandle);
+        CloseHandle((HANDLE)this->fileHandle);
+        this->fileHandle = NULL;
+        this->mappingHandle = NULL;
+#else
+        munmap((void*)this->data, this->size);
+#endif
+        this->data = NULL;
+        this->size = 0;
+    }
+
+    const unsigned char* MappedFile::GetData() const
+    {
+        return this->data;
+    }
+
+    size_t MappedFile::GetSize() const
+    {
+        return this->size;
+    }
+}
@@ -1,71 +1,199 @@
 #include "Mesh.hpp"
+#include "GLStateCache.hpp"
+#include "Simplifier.hpp"
+
+#include <algorithm>
+#include <utility>
+
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+		const VertexQuantization& quantization, CpuGeometry cpuGeometry)
+	{
+		this->textures = std::move(textures);
+
+		// the arguments are the working copy, released when the constructor returns
+		this->setupMesh(vertices, indices, quantization, cpuGeometry);
+	}
+
+	Mesh::Mesh(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount, std::vector<Texture> textures,
+		const VertexQuantization& quantization, CpuGeometry cpuGeometry)
+	{
+		this->textures = std::move(textures);
+
+		// setup reorders both arrays, so it needs its own copy
+		std::vector<Vertex> vertexCopy(vertices, vertices + vertexCount);
+		std::vector<GLuint> indexCopy(indices, indices + indexCount);
+		this->setupMesh(vertexCopy, indexCopy, quantization, cpuGeometry);
+	}
+
+	void Mesh::setupMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, const VertexQuantization& quantization,
+		CpuGeometry cpuGeometry)
+	{
+		this->vertexCount = vertices.size();
+		this->importCacheStatistics = AnalyzeVertexCache(&indices[0], indices.size());
+
+		this->bvh.Build(&vertices[0].Position, sizeof(Vertex), &indices[0], indices.size());
+		BuildMeshlets(this->bvh, &vertices[0].Position, sizeof(Vertex), &indices[0], this->meshlets);
+		this->bounds = Culling::ComputeBounds(&vertices[0].Position, vertices.size(), sizeof(Vertex));
+
+		// triangles only move inside their meshlet, so culling still finds the same runs;
+		// the BVH leaves below the meshlets just need their boxes refitted
+		for (size_t i = 0; i < this->meshlets.size(); i++) {
+			GLuint* meshletIndices = &indices[3 * this->meshlets[i].firstTriangle];
+			size_t meshletIndexCount = 3 * this->meshlets[i].triangleCount;
+			OptimizeVertexCache(meshletIndices, meshletIndexCount);
+			OptimizeOverdraw(meshletIndices, meshletIndexCount, &vertices[0].Position, sizeof(Vertex), this->bounds.center);
+		}
+		OptimizeVertexFetch(&vertices[0], vertices.size(), sizeof(Vertex), &indices[0], indices.size());
+		this->bvh.Refit(&vertices[0].Position, sizeof(Vertex), &indices[0]);
+		this->cacheStatistics = AnalyzeVertexCache(&indices[0], indices.size());
+
+		std::vector<GpuVertex> gpuVertices(vertices.size());
+		this->quantizationError = EncodeVertices<GpuVertexFormat>(&vertices[0], vertices.size(), quantization, &gpuVertices[0]);
+		this->range = GeometryArena::GetInstance().Allocate(&gpuVertices[0], gpuVertices.size(), &indices[0], indices.size());
+
+		MeshLod full;
+		full.firstIndex = this->range.firstIndex;
+		full.indexCount = this->range.indexCount;
+		full.error = 0.0f;
+		this->lods.assign(1, full);
+
+		// the coarser levels index the same vertices, so only their indices are added
+		static const float LOD_RATIOS[] = { 0.5f, 0.25f, 0.125f };
+		std::vector<SimplifiedLevel> levels;
+		if (indices.size() / 3 >= MIN_LOD_TRIANGLES) {
+			SimplifyMesh(&vertices[0], vertices.size(), &indices[0], indices.size(), LOD_RATIOS, 3, levels);
+		}
+		for (size_t i = 0; i < levels.size(); i++) {
+			OptimizeVertexCache(&levels[i].indices[0], levels[i].indices.size());
+			OptimizeOverdraw(&levels[i].indices[0], levels[i].indices.size(), &vertices[0].Position, sizeof(Vertex), this->bounds.center);
+			MeshLod lod;
+			lod.firstIndex = GeometryArena::GetInstance().AllocateIndices(&levels[i].indices[0], levels[i].indices.size(),
+				this->range.indexType);
+			lod.indexCount = (GLsizei)levels[i].indices.size();
+			lod.error = levels[i].error;
+			this->lods.push_back(lod);
+		}
+
+		// the GPU has everything now; picking needs positions and triangles only
+		if (cpuGeometry == KEEP_PICKING_GEOMETRY) {
+			this->positions.resize(vertices.size());
+			for (size_t i = 0; i < vertices.size(); i++) {
+				this->positions[i] = vertices[i].Position;
+			}
+			this->indices = std::move(indices);
+			this->indices.shrink_to_fit();
+		}
+	}
+
+	GeometryRange Mesh::getRange() const {
+	    return this->range;
+	}
+
+	const Bounds& Mesh::getBounds() const {
+	    return this->bounds;
+	}
+
+	const std::vector<MeshLod>& Mesh::getLods() const {
+	    return this->lods;
+	}
+
+	const Bvh& Mesh::getBvh() const {
+	    return this->bvh;
+	}
+
+	const VertexCacheStatistics& Mesh::getImportCacheStatistics() const {
+	    return this->importCacheStatistics;
+	}
+
+	const VertexCacheStatistics& Mesh::getCacheStatistics() const {
+	    return this->cacheStatistics;
+	}
+
+	const QuantizationError& Mesh::getQuantizationError() const {
+	    return this->quantizationError;
+	}
+
+	MeshMemory Mesh::getMemoryUsage() const {
+	    size_t indexSize = this->range.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	    MeshMemory memory;
+	    memory.gpuVertexBytes = this->vertexCount * sizeof(GpuVertex);
+	    memory.gpuIndexBytes = 0;
+	    for (size_t i = 0; i < this->lods.size(); i++) {
+	        memory.gpuIndexBytes += this->lods[i].indexCount * indexSize;
+	    }
+	    memory.cpuGeometryBytes = this->positions.capacity() * sizeof(glm::vec3) + this->indices.capacity() * sizeof(GLuint);
+	    memory.cpuHierarchyBytes = this->bvh.GetNodes().capacity() * sizeof(BvhNode) + this->meshlets.capacity() * sizeof(Meshlet);
+	    memory.importBytes = this->vertexCount * sizeof(Vertex) + this->range.indexCount * sizeof(GLuint);
+	    return memory;
+	}
+
+	static bool MeshletBefore(const Meshlet& meshlet, GLuint triangle)
+	{
+		return meshlet.firstTriangle < triangle;
+	}
+
+	size_t Mesh::Cull(const Culling::Frustum& frustum, const glm::vec3& eye, bool backfaceCulling,
+		std::vector<TriangleRange>& candidates, std::vector<TriangleRange>& ranges, size_t& backfaceTriangles) const
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		if (!backfaceCulling) {
+			return this->bvh.Cull(frustum, MAX_MESHLET_TRIANGLES, ranges);
+		}
+
+		candidates.clear();
+		this->bvh.Cull(frustum, MAX_MESHLET_TRIANGLES, candidates);
 
-		this->setupMesh();
+		// the BVH stops at meshlet nodes, so every candidate run is made of whole meshlets
+		size_t triangles = 0;
+		for (size_t i = 0; i < candidates.size(); i++) {
+			GLuint end = candidates[i].firstTriangle + candidates[i].triangleCount;
+			std::vector<Meshlet>::const_iterator meshlet = std::lower_bound(this->meshlets.begin(), this->meshlets.end(),
+				candidates[i].firstTriangle, MeshletBefore);
+			for (; meshlet != this->meshlets.end() && meshlet->firstTriangle < end; ++meshlet) {
+				if (IsBackfacing(*meshlet, eye)) {
+					backfaceTriangles += meshlet->triangleCount;
+					continue;
+				}
+				if (!ranges.empty() && ranges.back().firstTriangle + ranges.back().triangleCount == meshlet->firstTriangle) {
+					ranges.back().triangleCount += meshlet->triangleCount;
+				} else {
+					TriangleRange range;
+					range.firstTriangle = meshlet->firstTriangle;
+					range.triangleCount = meshlet->triangleCount;
+					ranges.push_back(range);
+				}
+				triangles += meshlet->triangleCount;
+			}
+		}
+		return triangles;
 	}
 
-	Buffers Mesh::getBuffers() {
-	    return this->buffers;
+	bool Mesh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance) const
+	{
+		if (this->positions.empty()) {
+			return false;
+		}
+		return this->bvh.Raycast(origin, direction, &this->positions[0], sizeof(glm::vec3), &this->indices[0], distance);
 	}
 
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(const gps::Shader& shader)
 	{
 		shader.useShaderProgram();
+		BindTextures(shader);
+		GeometryArena::GetInstance().Draw(this->range);
+	}
 
-		//set textures
+	void Mesh::BindTextures(const gps::Shader& shader) const
+	{
+		// bindings stay in place for the next mesh, which often uses the same ones
+		GLStateCache& state = GLStateCache::GetInstance();
 		for (GLuint i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			shader.setInt(this->textures[i].type, i);
+			state.BindTexture(i, GL_TEXTURE_2D, this->textures[i].id);
 		}
-
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
-        for(GLuint i = 0; i < this->textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
-
-    }
-
-	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh(){
-		// Create buffers/arrays
-		glGenVertexArrays(1, &this->buffers.VAO);
-		glGenBuffers(1, &this->buffers.VBO);
-		glGenBuffers(1, &this->buffers.EBO);
-
-		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-
-		glBindVertexArray(0);
 	}
 }
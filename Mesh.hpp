@@ -4,7 +4,13 @@
 #include <GL/glew.h>
 #include "glm/glm.hpp"
 
+#include "Bvh.hpp"
+#include "Culling.hpp"
+#include "GeometryArena.hpp"
+#include "IndexOptimizer.hpp"
+#include "Meshlet.hpp"
 #include "Shader.hpp"
+#include "VertexFormat.hpp"
 
 #include <string>
 #include <vector>
@@ -12,13 +18,6 @@
 
 namespace gps {
 
-struct Vertex
-{
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-};
-
 struct Texture
 {
     GLuint id;
@@ -34,31 +33,122 @@ struct Material
         glm::vec3 specular;
     };
 
-struct Buffers {
-    GLuint VAO;
-    GLuint VBO;
-    GLuint EBO;
+// Texture referenced by a mesh before it is loaded into video memory
+struct TextureRef
+{
+    std::string type;
+    std::string path;
 };
 
-class Mesh
+// CPU-side result of importing one mesh
+struct MeshData
 {
-public:
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
+    std::vector<TextureRef> textures;
+    Material material;
+};
+
+// One level of detail: an index run over the mesh vertices in the GeometryArena
+struct MeshLod
+{
+    GLuint firstIndex;  // in the index type of the mesh range
+    GLsizei indexCount;
+    // how far (in mesh units) the simplified surface may stray from the full one
+    float error;
+};
+
+// What a mesh keeps on the CPU once its geometry is in the GeometryArena
+enum CpuGeometry
+{
+    DROP_GEOMETRY,          // bounds, BVH and meshlets only: culling works, picking never hits
+    KEEP_PICKING_GEOMETRY   // plus positions and indices for exact ray hits
+};
+
+// Bytes held for a mesh, by where they live
+struct MeshMemory
+{
+    size_t gpuVertexBytes;
+    size_t gpuIndexBytes;      // every LOD level
+    size_t cpuGeometryBytes;   // picking positions and indices
+    size_t cpuHierarchyBytes;  // BVH nodes and meshlets
+    size_t importBytes;        // the vertices and indices as loaded, for comparison
+};
+
+class Mesh
+{
+public:
     std::vector<Texture> textures;
 
-	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+	// Takes the geometry over (pass it with std::move to avoid copies): it is reordered,
+	// uploaded, then dropped or kept compact according to cpuGeometry. quantization is
+	// the box the GPU copy of the vertices is packed against.
+	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+		const VertexQuantization& quantization, CpuGeometry cpuGeometry);
+
+	// Same from caller-owned arrays (e.g. a mapped mesh cache), which are copied once
+	Mesh(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount, std::vector<Texture> textures,
+		const VertexQuantization& quantization, CpuGeometry cpuGeometry);
+
+	// Where the mesh lives in the shared GeometryArena buffers
+	GeometryRange getRange() const;
+
+	const Bounds& getBounds() const;
+
+	// Level 0 is the full mesh, each further level has about half the triangles
+	const std::vector<MeshLod>& getLods() const;
 
-	Buffers getBuffers();
+	// Hierarchy over the triangles, whose nodes map to runs of the index range
+	const Bvh& getBvh() const;
 
-	void Draw(gps::Shader shader);
+	// Post-transform cache behaviour of the full mesh as imported and as drawn
+	const VertexCacheStatistics& getImportCacheStatistics() const;
+	const VertexCacheStatistics& getCacheStatistics() const;
+
+	// What packing the vertices for the GPU lost
+	const QuantizationError& getQuantizationError() const;
+
+	MeshMemory getMemoryUsage() const;
+
+	// Appends the triangle runs worth drawing: the BVH rejects what lies outside the
+	// (object-space) frustum down to meshlet size, then with backfaceCulling the
+	// meshlets whose normal cone faces away from eye are dropped and counted in
+	// backfaceTriangles. candidates is scratch space. Returns the triangles appended.
+	size_t Cull(const Culling::Frustum& frustum, const glm::vec3& eye, bool backfaceCulling,
+		std::vector<TriangleRange>& candidates, std::vector<TriangleRange>& ranges, size_t& backfaceTriangles) const;
+
+	// Closest hit of an object-space ray nearer than distance, which it then updates;
+	// always false once the geometry was dropped
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+
+	void Draw(const gps::Shader& shader);
+
+	// Binds the mesh textures to units 0..n-1 and points the samplers at them
+	void BindTextures(const gps::Shader& shader) const;
 
 private:
     /*  Render data  */
-    Buffers buffers;
+    GeometryRange range;
+    Bounds bounds;
+    Bvh bvh;
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshLod> lods;
+    VertexCacheStatistics importCacheStatistics;
+    VertexCacheStatistics cacheStatistics;
+    QuantizationError quantizationError;
+    size_t vertexCount;
+    // kept for picking only, empty with DROP_GEOMETRY
+    std::vector<glm::vec3> positions;
+    std::vector<GLuint> indices;
+
+	// smaller meshes are not worth simplifying
+	static const size_t MIN_LOD_TRIANGLES = 256;
 
-	// Initializes all the buffer objects/arrays
-	void setupMesh();
+	// Builds the hierarchy (reordering the indices) and the meshlets, reorders triangles
+	// and vertices for the GPU caches, then uploads everything with the LOD chain and
+	// keeps what cpuGeometry asks for
+	void setupMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, const VertexQuantization& quantization,
+		CpuGeometry cpuGeometry);
 
 };
 
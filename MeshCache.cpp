@@ -0,0 +1,267 @@
+#include "MeshCache.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace gps {
+
+    // Bump whenever the layout of the file or of gps::Vertex changes
+    static const unsigned int MESH_CACHE_MAGIC = 0x4d535047; // "GPSM"
+    static const unsigned int MESH_CACHE_VERSION = 1;
+
+    struct FileStamp
+    {
+        unsigned long long size;
+        long long modificationTime;
+    };
+
+    static bool GetFileStamp(const std::string& fileName, FileStamp& stamp)
+    {
+        struct stat fileInfo;
+        if (stat(fileName.c_str(), &fileInfo) != 0) {
+            return false;
+        }
+        stamp.size = (unsigned long long)fileInfo.st_size;
+        stamp.modificationTime = (long long)fileInfo.st_mtime;
+        return true;
+    }
+
+    // Sequential writer used while building the cache file
+    class CacheWriter
+    {
+    public:
+        std::vector<unsigned char> bytes;
+
+        void Write(const void* data, size_t length) {
+            const unsigned char* begin = (const unsigned char*)data;
+            bytes.insert(bytes.end(), begin, begin + length);
+        }
+        void WriteUInt(unsigned int value) { Write(&value, sizeof(value)); }
+        void WriteString(const std::string& value) {
+            WriteUInt((unsigned int)value.size());
+            Write(value.data(), value.size());
+        }
+        // keeps the vertex and index arrays 4-byte aligned inside the mapping
+        void Align() {
+            while (bytes.size() % 4 != 0) {
+                bytes.push_back(0);
+            }
+        }
+    };
+
+    // Bounds-checked reader over the mapped cache file
+    class CacheReader
+    {
+    public:
+        CacheReader(const unsigned char* data, size_t size) : data(data), size(size), offset(0) {}
+
+        const unsigned char* Read(size_t length) {
+            if (length > size - offset) {
+                return NULL;
+            }
+            const unsigned char* current = data + offset;
+            offset += length;
+            return current;
+        }
+        bool ReadUInt(unsigned int& value) {
+            const unsigned char* bytes = Read(sizeof(value));
+            if (!bytes) {
+                return false;
+            }
+            memcpy(&value, bytes, sizeof(value));
+            return true;
+        }
+        bool ReadString(std::string& value) {
+            unsigned int length;
+            if (!ReadUInt(length)) {
+                return false;
+            }
+            const unsigned char* bytes = Read(length);
+            if (!bytes) {
+                return false;
+            }
+            value.assign((const char*)bytes, length);
+            return true;
+        }
+        bool Align() {
+            size_t padding = (4 - offset % 4) % 4;
+            return Read(padding) != NULL;
+        }
+
+    private:
+        const unsigned char* data;
+        size_t size;
+        size_t offset;
+    };
+
+    bool MeshCache::Open(const std::string& cacheFileName)
+    {
+        meshes.clear();
+        if (!file.Open(cacheFileName)) {
+            return false;
+        }
+
+        CacheReader reader(file.GetData(), file.GetSize());
+        unsigned int magic, version, vertexSize, sourceCount;
+        if (!reader.ReadUInt(magic) || magic != MESH_CACHE_MAGIC ||
+            !reader.ReadUInt(version) || version != MESH_CACHE_VERSION ||
+            !reader.ReadUInt(vertexSize) || vertexSize != sizeof(Vertex) ||
+            !reader.ReadUInt(sourceCount)) {
+            file.Close();
+            return false;
+        }
+
+        // reject the cache if any source file changed since it was written
+        for (unsigned int i = 0; i < sourceCount; i++) {
+            std::string sourceFile;
+            const unsigned char* storedStamp;
+            FileStamp currentStamp;
+            if (!reader.ReadString(sourceFile) || !(storedStamp = reader.Read(sizeof(FileStamp))) ||
+                !GetFileStamp(sourceFile, currentStamp) ||
+                memcmp(storedStamp, &currentStamp, sizeof(FileStamp)) != 0) {
+                file.Close();
+                return false;
+            }
+        }
+
+        unsigned int meshCount;
+        if (!reader.ReadUInt(meshCount)) {
+            file.Close();
+            return false;
+        }
+
+        meshes.resize(meshCount);
+        for (unsigned int i = 0; i < meshCount; i++) {
+            MeshView& mesh = meshes[i];
+            unsigned int vertexCount, indexCount, textureCount;
+            const unsigned char* material;
+            if (!reader.ReadUInt(vertexCount) || !reader.ReadUInt(indexCount) || !reader.ReadUInt(textureCount)) {
+                meshes.clear();
+                file.Close();
+                return false;
+            }
+
+            mesh.textures.resize(textureCount);
+            for (unsigned int t = 0; t < textureCount; t++) {
+                if (!reader.ReadString(mesh.textures[t].type) || !reader.ReadString(mesh.textures[t].path)) {
+                    meshes.clear();
+                    file.Close();
+                    return false;
+                }
+            }
+
+            if (!(material = reader.Read(sizeof(Material))) || !reader.Align()) {
+                meshes.clear();
+                file.Close();
+                return false;
+            }
+            memcpy(&mesh.material, material, sizeof(Material));
+
+            mesh.vertexCount = vertexCount;
+            mesh.indexCount = indexCount;
+            mesh.vertices = (const Vertex*)reader.Read((size_t)vertexCount * sizeof(Vertex));
+            mesh.indices = (const GLuint*)reader.Read((size_t)indexCount * sizeof(GLuint));
+            if (!mesh.vertices || !mesh.indices) {
+                meshes.clear();
+                file.Close();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    const std::vector<MeshView>& MeshCache::GetMeshes() const
+    {
+        return meshes;
+    }
+
+    bool MeshCache::Write(const std::string& cacheFileName, const std::vector<std::string>& sourceFiles,
+        const std::vector<MeshData>& meshes)
+    {
+        CacheWriter writer;
+        writer.WriteUInt(MESH_CACHE_MAGIC);
+        writer.WriteUInt(MESH_CACHE_VERSION);
+        writer.WriteUInt((unsigned int)sizeof(Vertex));
+
+        writer.WriteUInt((unsigned int)sourceFiles.size());
+        for (size_t i = 0; i < sourceFiles.size(); i++) {
+            FileStamp stamp;
+            if (!GetFileStamp(sourceFiles[i], stamp)) {
+                return false;
+            }
+            writer.WriteString(sourceFiles[i]);
+            writer.Write(&stamp, sizeof(stamp));
+        }
+
+        writer.WriteUInt((unsigned int)meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const MeshData& mesh = meshes[i];
+            writer.WriteUInt((unsigned int)mesh.vertices.size());
+            writer.WriteUInt((unsigned int)mesh.indices.size());
+            writer.WriteUInt((unsigned int)mesh.textures.size());
+            for (size_t t = 0; t < mesh.textures.size(); t++) {
+                writer.WriteString(mesh.textures[t].type);
+                writer.WriteString(mesh.textures[t].path);
+            }
+            writer.Write(&mesh.material, sizeof(Material));
+            writer.Align();
+            writer.Write(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            writer.Write(mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+        }
+
+        // write to a temporary file first so a crash never leaves a torn cache behind
+        std::string tempFileName = cacheFileName + ".tmp";
+        FILE* out = fopen(tempFileName.c_str(), "wb");
+        if (!out) {
+            fprintf(stderr, "WARNING: could not write mesh cache %s\n", cacheFileName.c_str());
+            return false;
+        }
+        size_t written = fwrite(writer.bytes.data(), 1, writer.bytes.size(), out);
+        fclose(out);
+        if (written != writer.bytes.size()) {
+            remove(tempFileName.c_str());
+            return false;
+        }
+
+        remove(cacheFileName.c_str());
+        return rename(tempFileName.c_str(), cacheFileName.c_str()) == 0;
+    }
+
+    std::string MeshCache::GetCachePath(const std::string& objFileName)
+    {
+        size_t extension = objFileName.find_last_of('.');
+        size_t separator = objFileName.find_last_of("/\\");
+        if (extension == std::string::npos || (separator != std::string::npos && extension < separator)) {
+            return objFileName + ".gpsmesh";
+        }
+        return objFileName.substr(0, extension) + ".gpsmesh";
+    }
+
+    std::vector<std::string> MeshCache::GetSourceFiles(const std::string& objFileName, const std::string& basePath)
+    {
+        std::vector<std::string> sourceFiles;
+        sourceFiles.push_back(objFileName);
+
+        // only the mtllib statements are of interest, so this is a plain line scan
+        std::ifstream objFile(objFileName.c_str());
+        std::string line;
+        while (std::getline(objFile, line)) {
+            if (line.compare(0, 7, "mtllib ") != 0) {
+                continue;
+            }
+            std::istringstream libraries(line.substr(7));
+            std::string library;
+            while (libraries >> library) {
+                sourceFiles.push_back(basePath + library);
+            }
+        }
+
+        return sourceFiles;
+    }
+}
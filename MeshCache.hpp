@@ -0,0 +1,50 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Mesh stored in a mapped cache file - the arrays point into the mapping
+    struct MeshView
+    {
+        const Vertex* vertices;
+        size_t vertexCount;
+        const GLuint* indices;
+        size_t indexCount;
+        std::vector<TextureRef> textures;
+        Material material;
+    };
+
+    // Binary cache of imported meshes (.gpsmesh), stored next to the source .obj.
+    // The cache records the size and modification time of the .obj and of every
+    // .mtl it references and is rejected as soon as one of them changes.
+    class MeshCache
+    {
+    public:
+        // Maps the cache file and validates it against its source files
+        bool Open(const std::string& cacheFileName);
+
+        const std::vector<MeshView>& GetMeshes() const;
+
+        // Serializes the imported meshes together with their source file stamps
+        static bool Write(const std::string& cacheFileName, const std::vector<std::string>& sourceFiles,
+            const std::vector<MeshData>& meshes);
+
+        // Path of the cache file belonging to an .obj file
+        static std::string GetCachePath(const std::string& objFileName);
+
+        // The .obj file itself plus the .mtl libraries it references
+        static std::vector<std::string> GetSourceFiles(const std::string& objFileName, const std::string& basePath);
+
+    private:
+        MappedFile file;
+        std::vector<MeshView> meshes;
+    };
+}
+
+#endif /* MeshCache_hpp */
@@ -0,0 +1,97 @@
+#include "Meshlet.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace gps {
+
+    static inline const glm::vec3& Position(const glm::vec3* positions, size_t strideBytes, GLuint vertex)
+    {
+        return *(const glm::vec3*)((const unsigned char*)positions + vertex * strideBytes);
+    }
+
+    static Meshlet MakeMeshlet(const BvhNode& node, const glm::vec3* positions, size_t strideBytes, const GLuint* indices)
+    {
+        Meshlet meshlet;
+        meshlet.firstTriangle = node.firstTriangle;
+        meshlet.triangleCount = node.triangleCount;
+
+        // sphere around the node box, shrunk to the farthest vertex
+        meshlet.center = (node.min + node.max) * 0.5f;
+        float radiusSquared = 0.0f;
+        glm::vec3 normalSum(0.0f);
+        GLuint end = node.firstTriangle + node.triangleCount;
+        for (GLuint t = node.firstTriangle; t < end; t++) {
+            const glm::vec3& a = Position(positions, strideBytes, indices[3 * t]);
+            const glm::vec3& b = Position(positions, strideBytes, indices[3 * t + 1]);
+            const glm::vec3& c = Position(positions, strideBytes, indices[3 * t + 2]);
+            glm::vec3 da = a - meshlet.center, db = b - meshlet.center, dc = c - meshlet.center;
+            radiusSquared = std::max(radiusSquared, std::max(glm::dot(da, da), std::max(glm::dot(db, db), glm::dot(dc, dc))));
+
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                normalSum += normal / length;
+            }
+        }
+        meshlet.radius = std::sqrt(radiusSquared);
+
+        meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.coneCutoff = 2.0f;
+        float axisLength = glm::length(normalSum);
+        if (axisLength <= 0.0f) {
+            return meshlet;
+        }
+        meshlet.coneAxis = normalSum / axisLength;
+
+        float minimumCosine = 1.0f;
+        for (GLuint t = node.firstTriangle; t < end; t++) {
+            const glm::vec3& a = Position(positions, strideBytes, indices[3 * t]);
+            glm::vec3 normal = glm::cross(Position(positions, strideBytes, indices[3 * t + 1]) - a,
+                Position(positions, strideBytes, indices[3 * t + 2]) - a);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                minimumCosine = std::min(minimumCosine, glm::dot(normal / length, meshlet.coneAxis));
+            }
+        }
+        // a cone of 90 degrees or more always has some normal facing the camera
+        if (minimumCosine > 0.0f) {
+            meshlet.coneCutoff = std::sqrt(1.0f - minimumCosine * minimumCosine);
+        }
+        return meshlet;
+    }
+
+    void BuildMeshlets(const Bvh& bvh, const glm::vec3* positions, size_t strideBytes, const GLuint* indices,
+        std::vector<Meshlet>& meshlets)
+    {
+        meshlets.clear();
+        const std::vector<BvhNode>& nodes = bvh.GetNodes();
+        if (nodes.empty()) {
+            return;
+        }
+
+        std::vector<GLuint> stack(1, 0);
+        while (!stack.empty()) {
+            GLuint index = stack.back();
+            stack.pop_back();
+            const BvhNode& node = nodes[index];
+            if (node.triangleCount <= MAX_MESHLET_TRIANGLES || node.rightChild == 0) {
+                meshlets.push_back(MakeMeshlet(node, positions, strideBytes, indices));
+            } else {
+                // left on top, so meshlets come out in triangle order
+                stack.push_back(node.rightChild);
+                stack.push_back(index + 1);
+            }
+        }
+    }
+
+    bool IsBackfacing(const Meshlet& meshlet, const glm::vec3& eye)
+    {
+        // every face points away when the view vector to any point of the sphere stays
+        // within 90 degrees of every normal in the cone
+        glm::vec3 toCenter = meshlet.center - eye;
+        return glm::dot(toCenter, meshlet.coneAxis) - meshlet.radius
+            >= meshlet.coneCutoff * (glm::length(toCenter) + meshlet.radius);
+    }
+}
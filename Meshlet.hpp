@@ -0,0 +1,37 @@
+#ifndef Meshlet_hpp
+#define Meshlet_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Bvh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Cluster of up to MAX_MESHLET_TRIANGLES consecutive triangles of a mesh
+    struct Meshlet
+    {
+        GLuint firstTriangle;
+        GLuint triangleCount;
+        glm::vec3 center;
+        float radius;
+        // every face normal lies within the cone around coneAxis
+        glm::vec3 coneAxis;
+        // sine of the cone half angle; above 1 when the cone is too wide to ever cull
+        float coneCutoff;
+    };
+
+    static const GLuint MAX_MESHLET_TRIANGLES = 128;
+
+    // Splits a mesh into meshlets along its BVH: each meshlet is the largest node of at
+    // most MAX_MESHLET_TRIANGLES, so meshlets come out sorted and cover every triangle
+    void BuildMeshlets(const Bvh& bvh, const glm::vec3* positions, size_t strideBytes, const GLuint* indices,
+        std::vector<Meshlet>& meshlets);
+
+    // True when no triangle of the meshlet can face a camera at `eye` (same space as the meshlet)
+    bool IsBackfacing(const Meshlet& meshlet, const glm::vec3& eye);
+}
+
+#endif /* Meshlet_hpp */
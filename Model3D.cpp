@@ -1,27 +1,366 @@
 #include "Model3D.hpp"
+#include "MeshCache.hpp"
+#include "ObjLoader.hpp"
+#include "TextureCache.hpp"
+
+#include <cstdio>
+#include <utility>
 
 namespace gps {
 
-	void Model3D::LoadModel(std::string fileName)
+	// Identifies a face corner by the attribute indices it references
+	struct VertexKey {
+		int vertex_index;
+		int normal_index;
+		int texcoord_index;
+
+		bool operator==(const VertexKey& other) const {
+			return vertex_index == other.vertex_index &&
+				normal_index == other.normal_index &&
+				texcoord_index == other.texcoord_index;
+		}
+	};
+
+	struct VertexKeyHash {
+		size_t operator()(const VertexKey& key) const {
+			size_t h = (size_t)(unsigned int)key.vertex_index * 73856093u;
+			h ^= (size_t)(unsigned int)key.normal_index * 19349663u;
+			h ^= (size_t)(unsigned int)key.texcoord_index * 83492791u;
+			return h;
+		}
+	};
+
+	void Model3D::LoadModel(std::string fileName, CpuGeometry cpuGeometry)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath, cpuGeometry);
+	}
+
+    void Model3D::LoadModel(std::string fileName, std::string basePath, CpuGeometry cpuGeometry)
+	{
+		// the binary cache skips the .obj parsing entirely while it is up to date
+		std::string cacheFileName = MeshCache::GetCachePath(fileName);
+		MeshCache cache;
+		if (cache.Open(cacheFileName)) {
+			std::cout << "Loading : " << fileName << " (cached)" << std::endl;
+			const std::vector<MeshView>& views = cache.GetMeshes();
+			quantization = EmptyQuantization();
+			for (size_t i = 0; i < views.size(); i++) {
+				IncludeVertices(quantization, views[i].vertices, views[i].vertexCount);
+			}
+			for (size_t i = 0; i < views.size(); i++) {
+				meshes.push_back(gps::Mesh(views[i].vertices, views[i].vertexCount, views[i].indices, views[i].indexCount,
+					LoadTextures(views[i].textures), quantization, cpuGeometry));
+			}
+			BuildBatches();
+			return;
+		}
+
+		std::vector<MeshData> meshData;
+		ReadOBJ(fileName, basePath, meshData);
+		MeshCache::Write(cacheFileName, MeshCache::GetSourceFiles(fileName, basePath), meshData);
+
+		quantization = EmptyQuantization();
+		for (size_t i = 0; i < meshData.size(); i++) {
+			IncludeVertices(quantization, meshData[i].vertices.data(), meshData[i].vertices.size());
+		}
+		// the parsed geometry moves into the meshes, which drop it once uploaded
+		meshes.reserve(meshes.size() + meshData.size());
+		for (size_t i = 0; i < meshData.size(); i++) {
+			meshes.push_back(gps::Mesh(std::move(meshData[i].vertices), std::move(meshData[i].indices),
+				LoadTextures(meshData[i].textures), quantization, cpuGeometry));
+		}
+		BuildBatches();
+	}
+
+	static bool SameTextures(const std::vector<gps::Texture>& a, const std::vector<gps::Texture>& b)
+	{
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); i++) {
+			if (a[i].id != b[i].id || a[i].type != b[i].type) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void Model3D::BuildBatches()
+	{
+		batches.clear();
+		bounds.clear();
+		lodLevels.assign(meshes.size(), 0);
+		for (size_t i = 0; i < meshes.size(); i++) {
+			bounds.push_back(meshes[i].getBounds());
+			size_t b = 0;
+			// a multi-draw call takes one index type, so 32-bit meshes batch on their own
+			while (b < batches.size() && (!SameTextures(meshes[batches[b].mesh].textures, meshes[i].textures)
+				|| meshes[batches[b].mesh].getRange().indexType != meshes[i].getRange().indexType)) {
+				b++;
+			}
+			if (b == batches.size()) {
+				batches.push_back(DrawBatch());
+				batches.back().mesh = i;
+				batches.back().material = RenderQueue::GetMaterialId(meshes[i].textures);
+			}
+			GeometryArena::AddToBatch(meshes[i].getRange(), batches[b].draws);
+			batches[b].meshIndices.push_back(i);
+		}
+		PrintImportStatistics();
+	}
+
+	static void AddCacheStatistics(VertexCacheStatistics& total, const VertexCacheStatistics& mesh)
+	{
+		total.triangles += mesh.triangles;
+		total.vertices += mesh.vertices;
+		total.misses += mesh.misses;
+	}
+
+	void Model3D::PrintImportStatistics() const
+	{
+		VertexCacheStatistics imported = { 0, 0, 0 }, optimized = { 0, 0, 0 };
+		QuantizationError error = { 0.0f, 0.0f, 0.0f };
+		for (size_t i = 0; i < meshes.size(); i++) {
+			AddCacheStatistics(imported, meshes[i].getImportCacheStatistics());
+			AddCacheStatistics(optimized, meshes[i].getCacheStatistics());
+			AddQuantizationError(error, meshes[i].getQuantizationError());
+		}
+		fprintf(stdout, "Vertex cache   : ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%u-entry FIFO)\n",
+			imported.GetACMR(), optimized.GetACMR(), imported.GetATVR(), optimized.GetATVR(), (unsigned int)VERTEX_CACHE_SIZE);
+		fprintf(stdout, "Vertex format  : %u bytes (%u unpacked), max error %g units / %.3f deg / %g uv\n",
+			(unsigned int)sizeof(GpuVertex), (unsigned int)sizeof(Vertex), error.position, error.normalDegrees, error.texCoord);
+		if (!IsWithinLimits(error, quantization)) {
+			fprintf(stderr, "WARNING: vertex packing error is above the visible threshold\n");
+		}
+
+		MeshMemory memory = { 0, 0, 0, 0, 0 };
+		for (size_t i = 0; i < meshes.size(); i++) {
+			MeshMemory mesh = meshes[i].getMemoryUsage();
+			memory.gpuVertexBytes += mesh.gpuVertexBytes;
+			memory.gpuIndexBytes += mesh.gpuIndexBytes;
+			memory.cpuGeometryBytes += mesh.cpuGeometryBytes;
+			memory.cpuHierarchyBytes += mesh.cpuHierarchyBytes;
+			memory.importBytes += mesh.importBytes;
+		}
+		fprintf(stdout, "GPU memory     : %u KB (%u KB vertices, %u KB indices with LODs)\n",
+			(unsigned int)((memory.gpuVertexBytes + memory.gpuIndexBytes) / 1024),
+			(unsigned int)(memory.gpuVertexBytes / 1024), (unsigned int)(memory.gpuIndexBytes / 1024));
+		fprintf(stdout, "CPU memory     : %u KB (%u KB picking geometry, %u KB BVH and meshlets), was %u KB as loaded\n",
+			(unsigned int)((memory.cpuGeometryBytes + memory.cpuHierarchyBytes) / 1024),
+			(unsigned int)(memory.cpuGeometryBytes / 1024), (unsigned int)(memory.cpuHierarchyBytes / 1024),
+			(unsigned int)(memory.importBytes / 1024));
+	}
+
+	glm::mat4 Model3D::GetPositionDecode() const
+	{
+		return GpuVertexFormat::GetPositionDecode(quantization);
+	}
+
+	glm::vec4 Model3D::GetTexCoordDecode() const
+	{
+		return GpuVertexFormat::GetTexCoordDecode(quantization);
+	}
+
+	// Draw the model, one multi-draw call per texture set
+	void Model3D::Draw(const gps::Shader& shaderProgram)
+	{
+		shaderProgram.useShaderProgram();
+		shaderProgram.setVec4("texCoordDecode", GetTexCoordDecode());
+		GeometryArena& arena = GeometryArena::GetInstance();
+		for (size_t i = 0; i < batches.size(); i++) {
+			meshes[batches[i].mesh].BindTextures(shaderProgram);
+			arena.MultiDraw(batches[i].draws);
+		}
+	}
+
+	void Model3D::Submit(RenderQueue& queue, RenderPass pass, const gps::Shader& shaderProgram, size_t transform,
+		const glm::mat4& model, const Culling::Frustum& frustum, const glm::vec3* eye, float depth, bool textured)
+	{
+		if (meshes.empty()) {
+			return;
+		}
+		Culling::TransformBounds(&bounds[0], bounds.size(), model, worldBounds);
+		visibility.resize(bounds.size());
+		size_t visibleCount = Culling::CullBounds(frustum, worldBounds, &visibility[0]);
+
+		// meshes that survived are refined through their BVH in object space
+		Culling::Frustum objectFrustum = Culling::TransformFrustum(frustum, model);
+		glm::vec3 objectEye(0.0f);
+		if (eye) {
+			objectEye = glm::vec3(glm::inverse(model) * glm::vec4(*eye, 1.0f));
+		}
+		size_t visibleTriangles = 0, totalTriangles = 0, backfaceTriangles = 0;
+		for (size_t i = 0; i < batches.size(); i++) {
+			DrawBatch& batch = batches[i];
+			MultiDrawBatch& draws = batch.visible[pass];
+			draws.counts.clear();
+			draws.offsets.clear();
+			draws.baseVertices.clear();
+			for (size_t m = 0; m < batch.meshIndices.size(); m++) {
+				const gps::Mesh& mesh = meshes[batch.meshIndices[m]];
+				GeometryRange range = mesh.getRange();
+				int lodLevel = lodLevels[batch.meshIndices[m]];
+				if (lodLevel > 0) {
+					// distant enough that fine-grained culling is not worth it
+					const MeshLod& lod = mesh.getLods()[lodLevel];
+					totalTriangles += lod.indexCount / 3;
+					if (visibility[batch.meshIndices[m]]) {
+						range.firstIndex = lod.firstIndex;
+						range.indexCount = lod.indexCount;
+						GeometryArena::AddToBatch(range, draws);
+						visibleTriangles += lod.indexCount / 3;
+					}
+					continue;
+				}
+
+				totalTriangles += range.indexCount / 3;
+				if (!visibility[batch.meshIndices[m]]) {
+					continue;
+				}
+
+				clusters.clear();
+				visibleTriangles += mesh.Cull(objectFrustum, objectEye, eye != NULL, candidates, clusters, backfaceTriangles);
+				for (size_t c = 0; c < clusters.size(); c++) {
+					GeometryRange cluster = range;
+					cluster.firstIndex = range.firstIndex + clusters[c].firstTriangle * 3;
+					cluster.indexCount = (GLsizei)clusters[c].triangleCount * 3;
+					GeometryArena::AddToBatch(cluster, draws);
+				}
+			}
+			if (draws.counts.empty()) {
+				continue;
+			}
+			const gps::Mesh* textures = textured ? &meshes[batch.mesh] : NULL;
+			queue.Submit(pass, shaderProgram, textures, batch.material, draws, transform, depth);
+		}
+		Culling::AddResults(pass, visibleCount, meshes.size() - visibleCount, visibleTriangles,
+			totalTriangles - visibleTriangles - backfaceTriangles, backfaceTriangles);
 	}
 
-    void Model3D::LoadModel(std::string fileName, std::string basePath)
+	void Model3D::DrawDepth(const glm::mat4& model, const glm::vec3& center, float radius)
 	{
-		ReadOBJ(fileName, basePath);
+		if (meshes.empty()) {
+			return;
+		}
+		// the box around the sphere, as a frustum the mesh boxes and BVHs already cull against
+		Culling::Frustum box;
+		for (int axis = 0; axis < 3; axis++) {
+			glm::vec3 normal(0.0f);
+			normal[axis] = 1.0f;
+			box.planes[2 * axis] = glm::vec4(normal, radius - center[axis]);
+			box.planes[2 * axis + 1] = glm::vec4(-normal, radius + center[axis]);
+		}
+		Culling::TransformBounds(&bounds[0], bounds.size(), model, worldBounds);
+		visibility.resize(bounds.size());
+		Culling::CullBounds(box, worldBounds, &visibility[0]);
+		Culling::Frustum objectBox = Culling::TransformFrustum(box, model);
+
+		GeometryArena& arena = GeometryArena::GetInstance();
+		size_t backfaceTriangles = 0;
+		for (size_t i = 0; i < batches.size(); i++) {
+			const DrawBatch& batch = batches[i];
+			depthDraws.counts.clear();
+			depthDraws.offsets.clear();
+			depthDraws.baseVertices.clear();
+			for (size_t m = 0; m < batch.meshIndices.size(); m++) {
+				size_t index = batch.meshIndices[m];
+				if (!visibility[index]) {
+					continue;
+				}
+				// boxes in the corners of the cube can still miss the sphere
+				glm::vec3 boxCenter(worldBounds.centerX[index], worldBounds.centerY[index], worldBounds.centerZ[index]);
+				glm::vec3 extent(worldBounds.extentX[index], worldBounds.extentY[index], worldBounds.extentZ[index]);
+				glm::vec3 closest = glm::clamp(center, boxCenter - extent, boxCenter + extent);
+				if (glm::dot(closest - center, closest - center) > radius * radius) {
+					continue;
+				}
+
+				const gps::Mesh& mesh = meshes[index];
+				GeometryRange range = mesh.getRange();
+				int lodLevel = lodLevels[index];
+				if (lodLevel > 0) {
+					const MeshLod& lod = mesh.getLods()[lodLevel];
+					range.firstIndex = lod.firstIndex;
+					range.indexCount = lod.indexCount;
+					GeometryArena::AddToBatch(range, depthDraws);
+					continue;
+				}
+				// the light sees both sides, so no meshlet is dropped for facing away
+				clusters.clear();
+				mesh.Cull(objectBox, glm::vec3(0.0f), false, candidates, clusters, backfaceTriangles);
+				for (size_t c = 0; c < clusters.size(); c++) {
+					GeometryRange cluster = range;
+					cluster.firstIndex = range.firstIndex + clusters[c].firstTriangle * 3;
+					cluster.indexCount = (GLsizei)clusters[c].triangleCount * 3;
+					GeometryArena::AddToBatch(cluster, depthDraws);
+				}
+			}
+			arena.MultiDraw(depthDraws);
+		}
+	}
+
+	void Model3D::AddWorldBounds(const glm::mat4& model, std::vector<Bounds>& world) const
+	{
+		glm::mat3 linear(model);
+		glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+		for (size_t i = 0; i < bounds.size(); i++) {
+			Bounds box;
+			box.center = glm::vec3(model * glm::vec4((bounds[i].min + bounds[i].max) * 0.5f, 1.0f));
+			glm::vec3 extent = absolute * ((bounds[i].max - bounds[i].min) * 0.5f);
+			box.min = box.center - extent;
+			box.max = box.center + extent;
+			box.radius = glm::length(extent);
+			world.push_back(box);
+		}
+	}
+
+	void Model3D::SelectLods(const glm::mat4& model, const glm::vec3& eye, float pixelsPerUnit)
+	{
+		glm::mat3 linear(model);
+		float scale = std::sqrt(std::max(glm::dot(linear[0], linear[0]),
+			std::max(glm::dot(linear[1], linear[1]), glm::dot(linear[2], linear[2]))));
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const std::vector<MeshLod>& lods = meshes[i].getLods();
+			if (lods.size() < 2) {
+				continue;
+			}
+
+			const Bounds& meshBounds = meshes[i].getBounds();
+			glm::vec3 center = glm::vec3(model * glm::vec4(meshBounds.center, 1.0f));
+			float distance = std::max(glm::length(center - eye) - meshBounds.radius * scale, 0.1f);
+			float pixelsPerError = pixelsPerUnit * scale / distance;
+
+			// refine while the current level is visibly off, coarsen only with some margin,
+			// so a mesh near a threshold does not switch back and forth every frame
+			int level = lodLevels[i];
+			while (level > 0 && lods[level].error * pixelsPerError > LOD_PIXEL_ERROR) {
+				level--;
+			}
+			while (level + 1 < (int)lods.size() && lods[level + 1].error * pixelsPerError < LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS)) {
+				level++;
+			}
+			lodLevels[i] = level;
+		}
 	}
 
-	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	bool Model3D::Raycast(const glm::vec3& origin, const glm::vec3& direction, const glm::mat4& model, float& distance) const
 	{
-		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+		// the direction is left unnormalized so distances stay in world units
+		glm::mat4 toObject = glm::inverse(model);
+		glm::vec3 objectOrigin = glm::vec3(toObject * glm::vec4(origin, 1.0f));
+		glm::vec3 objectDirection = glm::vec3(toObject * glm::vec4(direction, 0.0f));
+
+		bool hit = false;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			hit |= meshes[i].Raycast(objectOrigin, objectDirection, distance);
+		}
+		return hit;
 	}
 
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
+	void Model3D::ReadOBJ(std::string fileName, std::string basePath, std::vector<MeshData>& meshData){
 
         std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
@@ -30,7 +369,7 @@ namespace gps {
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		bool ret = gps::LoadObjParallel(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
@@ -40,14 +379,43 @@ namespace gps {
 			exit(1);
 		}
 
+#ifdef GPS_VERIFY_OBJ_PARSER
+		// conformance check of the parallel parser against the reference tinyobj parser;
+		// only runs when the mesh cache is rebuilt, tools/objcheck covers every model
+		{
+			tinyobj::attrib_t referenceAttrib;
+			std::vector<tinyobj::shape_t> referenceShapes;
+			std::vector<tinyobj::material_t> referenceMaterials;
+			std::string referenceErr, difference;
+			tinyobj::LoadObj(&referenceAttrib, &referenceShapes, &referenceMaterials, &referenceErr, fileName.c_str(), basePath.c_str(), GL_TRUE);
+			if (!gps::CompareObjResults(referenceAttrib, referenceShapes, referenceMaterials, attrib, shapes, materials, &difference)) {
+				std::cerr << "ERROR: parallel OBJ parser differs from tinyobj on " << fileName << ": " << difference << std::endl;
+				exit(1);
+			}
+		}
+#endif
+
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		size_t faceCorners = 0;
+		size_t uniqueVertices = 0;
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			meshData.push_back(MeshData());
+			std::vector<gps::Vertex>& vertices = meshData.back().vertices;
+			std::vector<GLuint>& indices = meshData.back().indices;
+			std::vector<gps::TextureRef>& textures = meshData.back().textures;
+			gps::Material& currentMaterial = meshData.back().material;
+			currentMaterial.ambient = glm::vec3(0.0f);
+			currentMaterial.diffuse = glm::vec3(0.0f);
+			currentMaterial.specular = glm::vec3(0.0f);
+
+			// Maps each (position, normal, texcoord) index triple to its slot in vertices
+			std::unordered_map<VertexKey, GLuint, VertexKeyHash> uniqueIndices;
+			uniqueIndices.reserve(shapes[s].mesh.indices.size());
+			indices.reserve(shapes[s].mesh.indices.size());
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -62,6 +430,14 @@ namespace gps {
 					// access to vertex
 					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
+					// reuse the vertex if this corner was already emitted
+					VertexKey key = { idx.vertex_index, idx.normal_index, idx.texcoord_index };
+					std::unordered_map<VertexKey, GLuint, VertexKeyHash>::iterator found = uniqueIndices.find(key);
+					if (found != uniqueIndices.end()) {
+						indices.push_back(found->second);
+						continue;
+					}
+
 					float vx = attrib.vertices[3 * idx.vertex_index + 0];
 					float vy = attrib.vertices[3 * idx.vertex_index + 1];
 					float vz = attrib.vertices[3 * idx.vertex_index + 2];
@@ -84,21 +460,25 @@ namespace gps {
 					currentVertex.Normal = vertexNormal;
 					currentVertex.TexCoords = vertexTexCoords;
 
+					GLuint newIndex = (GLuint)vertices.size();
+					uniqueIndices[key] = newIndex;
 					vertices.push_back(currentVertex);
 
-					indices.push_back(index_offset + v);
+					indices.push_back(newIndex);
 				}
 
 				index_offset += fv;
 			}
 
+			faceCorners += indices.size();
+			uniqueVertices += vertices.size();
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
 			int a = shapes[s].mesh.material_ids.size();
 			if (a > 0 && materials.size()>0) {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
-					gps::Material currentMaterial;
 					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
 					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
 					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
@@ -107,8 +487,9 @@ namespace gps {
 					std::string ambientTexturePath = materials[materialId].ambient_texname;
 					if (!ambientTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
+						gps::TextureRef currentTexture;
+						currentTexture.path = basePath + ambientTexturePath;
+						currentTexture.type = "ambientTexture";
 						textures.push_back(currentTexture);
 					}
 
@@ -116,8 +497,9 @@ namespace gps {
 					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
 					if (!diffuseTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
+						gps::TextureRef currentTexture;
+						currentTexture.path = basePath + diffuseTexturePath;
+						currentTexture.type = "diffuseTexture";
 						textures.push_back(currentTexture);
 					}
 
@@ -125,109 +507,56 @@ namespace gps {
 					std::string specularTexturePath = materials[materialId].specular_texname;
 					if (!specularTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
+						gps::TextureRef currentTexture;
+						currentTexture.path = basePath + specularTexturePath;
+						currentTexture.type = "specularTexture";
 						textures.push_back(currentTexture);
 					}
 				}
 			}
+		}
+
+		std::cout << "# of vertices  : " << uniqueVertices << " unique / " << faceCorners << " face corners" << std::endl;
+		std::cout << "Welding saved  : " << (faceCorners - uniqueVertices) * sizeof(gps::Vertex) / 1024 << " KB of vertex data" << std::endl;
+	}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+	// Loads every texture referenced by a mesh
+	std::vector<gps::Texture> Model3D::LoadTextures(const std::vector<gps::TextureRef>& textureRefs) {
+		std::vector<gps::Texture> textures;
+		for (size_t i = 0; i < textureRefs.size(); i++) {
+			textures.push_back(LoadTexture(textureRefs[i].path, textureRefs[i].type));
 		}
+		return textures;
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
 	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
-				if (loadedTextures[i].path == path)
-				{
-					//already loaded texture
-					return loadedTextures[i];
-				}
-			}
-
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
-			loadedTextures.push_back(currentTexture);
+			std::unordered_map<std::string, gps::Texture>::iterator found = loadedTextures.find(path);
+			if (found != loadedTextures.end())
+			{
+				//already loaded texture
+				currentTexture.id = found->second.id;
+				return currentTexture;
+			}
 
-			return currentTexture;
-		}
+			// shared with every other model using the same image
+			currentTexture.id = TextureCache::GetInstance().Acquire(path);
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
-		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
-		}
-
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
-		}
+			loadedTextures[path] = currentTexture;
 
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return textureID;
-	}
-
-	Model3D::~Model3D() {
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
-            glDeleteTextures(1, &loadedTextures.at(i).id);
-        }
+			return currentTexture;
+		}
 
-        for (size_t i = 0; i < meshes.size(); i++) {
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+	void Model3D::ReleaseTextures() {
+        for (std::unordered_map<std::string, gps::Texture>::iterator it = loadedTextures.begin(); it != loadedTextures.end(); ++it) {
+            TextureCache::GetInstance().Release(it->second.id);
         }
+        loadedTextures.clear();
+        // the geometry stays in the GeometryArena, which is never compacted
 	}
 }
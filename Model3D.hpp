@@ -2,12 +2,14 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "RenderQueue.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
 #include <iostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace gps {
@@ -16,28 +18,95 @@ namespace gps {
     {
 
     public:
-        ~Model3D();
+		// cpuGeometry says whether the meshes keep what picking needs after the upload
+		void LoadModel(std::string fileName, CpuGeometry cpuGeometry = KEEP_PICKING_GEOMETRY);
 
-		void LoadModel(std::string fileName);
+		void LoadModel(std::string fileName, std::string basePath, CpuGeometry cpuGeometry = KEEP_PICKING_GEOMETRY);
 
-		void LoadModel(std::string fileName, std::string basePath);
+		// The model uniform has to include GetPositionDecode()
+		void Draw(const gps::Shader& shaderProgram);
 
-		void Draw(gps::Shader shaderProgram);
+		// Turn the packed GPU vertices back into model space: the first goes after the
+		// model matrix, the second is the shaders' texCoordDecode (scale xy, offset zw)
+		glm::mat4 GetPositionDecode() const;
+		glm::vec4 GetTexCoordDecode() const;
+
+		// Culls the meshes against the pass frustum, and their meshlets against the camera
+		// at eye (world space, NULL to keep backfacing meshlets), then queues one draw per
+		// texture set with the survivors; textured is false for passes that sample none.
+		// Meant to be called once per pass and frame, the visible lists live until the queue flushes.
+		void Submit(RenderQueue& queue, RenderPass pass, const gps::Shader& shaderProgram, size_t transform,
+			const glm::mat4& model, const Culling::Frustum& frustum, const glm::vec3* eye, float depth, bool textured);
+
+		// Draws the meshes placed with `model` that reach into the world-space sphere, at
+		// the levels SelectLods picked and with no textures bound, for depth-only passes
+		// that are not queued. The model uniform has to be set as for Draw.
+		void DrawDepth(const glm::mat4& model, const glm::vec3& center, float radius);
+
+		// Hands the textures back to the TextureCache. Call it while the GL context is
+		// alive: the models are globals, destroyed after the cache and the window.
+		void ReleaseTextures();
+
+		// Appends the world-space boxes of the meshes placed with `model`
+		void AddWorldBounds(const glm::mat4& model, std::vector<Bounds>& world) const;
+
+		// Picks each mesh's level of detail for this frame from its projected error;
+		// pixelsPerUnit is the screen size in pixels of one unit at distance one
+		void SelectLods(const glm::mat4& model, const glm::vec3& eye, float pixelsPerUnit);
+
+		// Closest hit of a world-space ray against the model placed with `model`,
+		// nearer than distance (updated on a hit)
+		bool Raycast(const glm::vec3& origin, const glm::vec3& direction, const glm::mat4& model, float& distance) const;
 
     private:
+		// largest projected LOD error tolerated, in pixels, and the margin a mesh
+		// has to clear before it switches to a coarser level
+		static constexpr float LOD_PIXEL_ERROR = 1.0f;
+		static constexpr float LOD_HYSTERESIS = 0.25f;
+
+		// Meshes sharing a texture set, drawn by one multi-draw call
+		struct DrawBatch {
+			size_t mesh;  // first mesh of the batch, supplies the textures
+			GLuint material;
+			MultiDrawBatch draws;
+			std::vector<size_t> meshIndices;
+			// meshes that passed culling, kept until the queue is flushed
+			MultiDrawBatch visible[Culling::PASS_COUNT];
+		};
+
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
-		// Associated textures
-        std::vector<gps::Texture> loadedTextures;
+        std::vector<DrawBatch> batches;
+		// mesh bounds side by side for the culling kernel
+        std::vector<Bounds> bounds;
+        Culling::WorldBounds worldBounds;
+        std::vector<unsigned char> visibility;
+        std::vector<TriangleRange> candidates;
+        std::vector<TriangleRange> clusters;
+		// scratch batch of DrawDepth, reused so the draws do not allocate
+        MultiDrawBatch depthDraws;
+		// level of detail drawn for each mesh, kept between frames for the hysteresis
+        std::vector<int> lodLevels;
+		// box shared by the packed vertices of every mesh
+        VertexQuantization quantization;
+		// Associated textures, by path
+        std::unordered_map<std::string, gps::Texture> loadedTextures;
 
 		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		void ReadOBJ(std::string fileName, std::string basePath, std::vector<MeshData>& meshData);
+
+		// Groups the meshes by texture set into batches
+		void BuildBatches();
+
+		// Post-transform cache efficiency before and after the import reordering,
+		// what packing the vertices cost and where the model's memory went
+		void PrintImportStatistics() const;
+
+		// Retrieves all textures referenced by a mesh
+		std::vector<gps::Texture> LoadTextures(const std::vector<gps::TextureRef>& textureRefs);
 
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
-
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
     };
 }
 
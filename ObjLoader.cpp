@@ -0,0 +1,717 @@
+#include "ObjLoader.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace gps {
+
+    // Chunks smaller than this are not worth a task of their own
+    static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+    enum ObjCommandType { OBJ_USEMTL, OBJ_MTLLIB, OBJ_GROUP, OBJ_OBJECT, OBJ_TAG };
+
+    // Statement that has to be replayed in file order during the merge
+    struct ObjCommand
+    {
+        ObjCommandType type;
+        size_t faceIndex; // number of faces of the chunk that precede the statement
+        std::string text;
+    };
+
+    // Face corner whose negative (relative) indices were resolved against the
+    // chunk-local attribute counts; the merge adds the counts of earlier chunks
+    struct ObjRelativeCorner
+    {
+        size_t corner;
+        unsigned char mask; // 1 = vertex, 2 = normal, 4 = texcoord
+    };
+
+    struct ObjChunk
+    {
+        std::vector<float> v;
+        std::vector<float> vn;
+        std::vector<float> vt;
+        std::vector<tinyobj::index_t> corners;
+        std::vector<unsigned int> faceSizes;
+        std::vector<ObjCommand> commands;
+        std::vector<ObjRelativeCorner> relativeCorners;
+    };
+
+    // Bounded versions of the tokenizer helpers used by tinyobj so the
+    // chunks can be parsed in place without copying every line
+
+    static inline bool IsSpace(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    static inline bool IsDigit(char c) {
+        return (unsigned int)(c - '0') < 10u;
+    }
+
+    static inline bool IsCSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+
+    // strspn(token, " \t")
+    static inline const char* SkipSpaces(const char* token, const char* end) {
+        while (token < end && IsSpace(*token)) {
+            token++;
+        }
+        return token;
+    }
+
+    // strcspn(token, " \t\r") or strcspn(token, "/ \t\r")
+    static inline const char* FindDelimiter(const char* token, const char* end, bool slash) {
+        while (token < end && !IsSpace(*token) && *token != '\r' && !(slash && *token == '/')) {
+            token++;
+        }
+        return token;
+    }
+
+    // atoi
+    static inline int ParseInt(const char* token, const char* end) {
+        while (token < end && IsCSpace(*token)) {
+            token++;
+        }
+        bool negative = false;
+        if (token < end && (*token == '+' || *token == '-')) {
+            negative = *token == '-';
+            token++;
+        }
+        int value = 0;
+        while (token < end && IsDigit(*token)) {
+            value = value * 10 + (*token - '0');
+            token++;
+        }
+        return negative ? -value : value;
+    }
+
+    // sscanf(token, "%s")
+    static inline std::string ParseWord(const char* token, const char* end) {
+        while (token < end && IsCSpace(*token)) {
+            token++;
+        }
+        const char* wordEnd = token;
+        while (wordEnd < end && !IsCSpace(*wordEnd)) {
+            wordEnd++;
+        }
+        return std::string(token, wordEnd);
+    }
+
+    // Same algorithm (and therefore the same rounding) as tinyobj's tryParseDouble
+    static bool TryParseDouble(const char* s, const char* s_end, double* result) {
+        if (s >= s_end) {
+            return false;
+        }
+
+        double mantissa = 0.0;
+        int exponent = 0;
+        char sign = '+';
+        char exp_sign = '+';
+        const char* curr = s;
+        int read = 0;
+        bool end_not_reached = false;
+
+        if (*curr == '+' || *curr == '-') {
+            sign = *curr;
+            curr++;
+        } else if (!IsDigit(*curr)) {
+            return false;
+        }
+
+        end_not_reached = (curr != s_end);
+        while (end_not_reached && IsDigit(*curr)) {
+            mantissa *= 10;
+            mantissa += static_cast<int>(*curr - 0x30);
+            curr++;
+            read++;
+            end_not_reached = (curr != s_end);
+        }
+
+        if (read == 0) {
+            return false;
+        }
+
+        if (end_not_reached) {
+            bool parseExponent = true;
+            if (*curr == '.') {
+                curr++;
+                read = 1;
+                end_not_reached = (curr != s_end);
+                while (end_not_reached && IsDigit(*curr)) {
+                    static const double pow_lut[] = {
+                        1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+                    };
+                    const int lut_entries = sizeof pow_lut / sizeof pow_lut[0];
+
+                    mantissa += static_cast<int>(*curr - 0x30) *
+                        (read < lut_entries ? pow_lut[read] : pow(10.0, -read));
+                    read++;
+                    curr++;
+                    end_not_reached = (curr != s_end);
+                }
+            } else if (*curr != 'e' && *curr != 'E') {
+                parseExponent = false;
+            }
+
+            if (parseExponent && end_not_reached && (*curr == 'e' || *curr == 'E')) {
+                curr++;
+                end_not_reached = (curr != s_end);
+                if (end_not_reached && (*curr == '+' || *curr == '-')) {
+                    exp_sign = *curr;
+                    curr++;
+                } else if (!end_not_reached || !IsDigit(*curr)) {
+                    return false;
+                }
+
+                read = 0;
+                end_not_reached = (curr != s_end);
+                while (end_not_reached && IsDigit(*curr)) {
+                    exponent *= 10;
+                    exponent += static_cast<int>(*curr - 0x30);
+                    curr++;
+                    read++;
+                    end_not_reached = (curr != s_end);
+                }
+                exponent *= (exp_sign == '+' ? 1 : -1);
+                if (read == 0) {
+                    return false;
+                }
+            }
+        }
+
+        *result = (sign == '+' ? 1 : -1) *
+            (exponent ? ldexp(mantissa * pow(5.0, exponent), exponent) : mantissa);
+        return true;
+    }
+
+    static inline float ParseFloat(const char** token, const char* end, double defaultValue = 0.0) {
+        *token = SkipSpaces(*token, end);
+        const char* valueEnd = FindDelimiter(*token, end, false);
+        double value = defaultValue;
+        TryParseDouble(*token, valueEnd, &value);
+        *token = valueEnd;
+        return static_cast<float>(value);
+    }
+
+    // fixIndex for one component; negative indices stay chunk-relative
+    static inline int FixIndex(int index, int localCount, unsigned char bit, unsigned char& mask) {
+        if (index > 0) {
+            return index - 1;
+        }
+        if (index == 0) {
+            return 0;
+        }
+        mask |= bit;
+        return localCount + index;
+    }
+
+    // Parses i, i/j/k, i//k or i/j
+    static inline void ParseTriple(const char** token, const char* end, const ObjChunk& chunk,
+        tinyobj::index_t& corner, unsigned char& mask) {
+        corner.vertex_index = -1;
+        corner.normal_index = -1;
+        corner.texcoord_index = -1;
+        mask = 0;
+
+        int vertexCount = (int)(chunk.v.size() / 3);
+        int normalCount = (int)(chunk.vn.size() / 3);
+        int texcoordCount = (int)(chunk.vt.size() / 2);
+
+        corner.vertex_index = FixIndex(ParseInt(*token, end), vertexCount, 1, mask);
+        *token = FindDelimiter(*token, end, true);
+        if (*token == end || **token != '/') {
+            return;
+        }
+        (*token)++;
+
+        // i//k
+        if (*token < end && **token == '/') {
+            (*token)++;
+            corner.normal_index = FixIndex(ParseInt(*token, end), normalCount, 2, mask);
+            *token = FindDelimiter(*token, end, true);
+            return;
+        }
+
+        // i/j/k or i/j
+        corner.texcoord_index = FixIndex(ParseInt(*token, end), texcoordCount, 4, mask);
+        *token = FindDelimiter(*token, end, true);
+        if (*token == end || **token != '/') {
+            return;
+        }
+
+        // i/j/k
+        (*token)++;
+        corner.normal_index = FixIndex(ParseInt(*token, end), normalCount, 2, mask);
+        *token = FindDelimiter(*token, end, true);
+    }
+
+    static void ParseLine(const char* token, const char* end, ObjChunk& chunk) {
+        token = SkipSpaces(token, end);
+        if (token == end || token[0] == '#') {
+            return;
+        }
+
+        size_t length = end - token;
+        char c1 = length > 1 ? token[1] : '\0';
+        char c2 = length > 2 ? token[2] : '\0';
+
+        // vertex
+        if (token[0] == 'v' && IsSpace(c1)) {
+            token += 2;
+            float x = ParseFloat(&token, end);
+            float y = ParseFloat(&token, end);
+            float z = ParseFloat(&token, end);
+            chunk.v.push_back(x);
+            chunk.v.push_back(y);
+            chunk.v.push_back(z);
+            return;
+        }
+
+        // normal
+        if (token[0] == 'v' && c1 == 'n' && IsSpace(c2)) {
+            token += 3;
+            float x = ParseFloat(&token, end);
+            float y = ParseFloat(&token, end);
+            float z = ParseFloat(&token, end);
+            chunk.vn.push_back(x);
+            chunk.vn.push_back(y);
+            chunk.vn.push_back(z);
+            return;
+        }
+
+        // texcoord
+        if (token[0] == 'v' && c1 == 't' && IsSpace(c2)) {
+            token += 3;
+            float x = ParseFloat(&token, end);
+            float y = ParseFloat(&token, end);
+            chunk.vt.push_back(x);
+            chunk.vt.push_back(y);
+            return;
+        }
+
+        // face
+        if (token[0] == 'f' && IsSpace(c1)) {
+            token = SkipSpaces(token + 2, end);
+
+            unsigned int faceSize = 0;
+            while (token < end) {
+                tinyobj::index_t corner;
+                unsigned char mask;
+                ParseTriple(&token, end, chunk, corner, mask);
+                if (mask) {
+                    ObjRelativeCorner relative = { chunk.corners.size(), mask };
+                    chunk.relativeCorners.push_back(relative);
+                }
+                chunk.corners.push_back(corner);
+                faceSize++;
+                while (token < end && (IsSpace(*token) || *token == '\r')) {
+                    token++;
+                }
+            }
+            chunk.faceSizes.push_back(faceSize);
+            return;
+        }
+
+        ObjCommand command;
+        command.faceIndex = chunk.faceSizes.size();
+
+        if (length > 6 && strncmp(token, "usemtl", 6) == 0 && IsSpace(token[6])) {
+            command.type = OBJ_USEMTL;
+            command.text = ParseWord(token + 7, end);
+            chunk.commands.push_back(command);
+            return;
+        }
+
+        if (length > 6 && strncmp(token, "mtllib", 6) == 0 && IsSpace(token[6])) {
+            command.type = OBJ_MTLLIB;
+            command.text = ParseWord(token + 7, end);
+            chunk.commands.push_back(command);
+            return;
+        }
+
+        // group name - only the first name after 'g' is kept
+        if (token[0] == 'g' && IsSpace(c1)) {
+            command.type = OBJ_GROUP;
+            int nameIndex = 0;
+            while (token < end) {
+                token = SkipSpaces(token, end);
+                const char* nameEnd = FindDelimiter(token, end, false);
+                if (nameIndex == 1) {
+                    command.text.assign(token, nameEnd);
+                }
+                nameIndex++;
+                token = nameEnd;
+                while (token < end && (IsSpace(*token) || *token == '\r')) {
+                    token++;
+                }
+            }
+            chunk.commands.push_back(command);
+            return;
+        }
+
+        // object name
+        if (token[0] == 'o' && IsSpace(c1)) {
+            command.type = OBJ_OBJECT;
+            command.text = ParseWord(token + 2, end);
+            chunk.commands.push_back(command);
+            return;
+        }
+
+        // subdivision tags are rare, they are parsed during the merge
+        if (token[0] == 't' && IsSpace(c1)) {
+            command.type = OBJ_TAG;
+            command.text.assign(token + 2, end);
+            chunk.commands.push_back(command);
+            return;
+        }
+
+        // Ignore unknown command.
+    }
+
+    static void ParseChunk(const char* begin, const char* end, ObjChunk* chunk) {
+        const char* line = begin;
+        while (line < end) {
+            // lines end at \n, \r\n or a lone \r, like safeGetline
+            const char* lineEnd = line;
+            while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r') {
+                lineEnd++;
+            }
+            const char* next = lineEnd;
+            if (next < end) {
+                next += (*next == '\r' && next + 1 < end && next[1] == '\n') ? 2 : 1;
+            }
+
+            // std::string::c_str() stops at an embedded NUL
+            const char* nul = (const char*)memchr(line, '\0', lineEnd - line);
+            ParseLine(line, nul ? nul : lineEnd, *chunk);
+            line = next;
+        }
+    }
+
+    // Port of the 't' statement parsing in tinyobj::LoadObj
+    static tinyobj::tag_t ParseTag(const std::string& text) {
+        tinyobj::tag_t tag;
+        const char* token = text.c_str();
+        const char* end = token + text.size();
+
+        tag.name = ParseWord(token, end);
+        token = std::min(end, token + tag.name.size() + 1);
+
+        int numInts = ParseInt(token, end);
+        int numFloats = 0;
+        int numStrings = 0;
+        token = FindDelimiter(token, end, true);
+        if (token < end && *token == '/') {
+            token++;
+            numFloats = ParseInt(token, end);
+            token = FindDelimiter(token, end, true);
+            if (token < end && *token == '/') {
+                token++;
+                numStrings = ParseInt(token, end);
+                token = std::min(end, FindDelimiter(token, end, true) + 1);
+            }
+        }
+
+        tag.intValues.resize(static_cast<size_t>(std::max(numInts, 0)));
+        for (size_t i = 0; i < tag.intValues.size(); ++i) {
+            tag.intValues[i] = ParseInt(token, end);
+            token = std::min(end, FindDelimiter(token, end, true) + 1);
+        }
+
+        tag.floatValues.resize(static_cast<size_t>(std::max(numFloats, 0)));
+        for (size_t i = 0; i < tag.floatValues.size(); ++i) {
+            tag.floatValues[i] = ParseFloat(&token, end);
+            token = std::min(end, FindDelimiter(token, end, true) + 1);
+        }
+
+        tag.stringValues.resize(static_cast<size_t>(std::max(numStrings, 0)));
+        for (size_t i = 0; i < tag.stringValues.size(); ++i) {
+            tag.stringValues[i] = ParseWord(token, end);
+            token = std::min(end, token + tag.stringValues[i].size() + 1);
+        }
+
+        return tag;
+    }
+
+    // Faces collected since the last flush - the equivalent of tinyobj's faceGroup
+    struct ObjFaceSpan
+    {
+        const ObjChunk* chunk;
+        size_t firstFace;
+        size_t faceCount;
+        size_t firstCorner;
+    };
+
+    // Mirrors tinyobj's exportFaceGroupToShape
+    static bool ExportFaceGroupToShape(tinyobj::shape_t* shape, const std::vector<ObjFaceSpan>& faceGroup,
+        const std::vector<tinyobj::tag_t>& tags, int materialId, const std::string& name, bool triangulate) {
+        if (faceGroup.empty()) {
+            return false;
+        }
+
+        for (size_t s = 0; s < faceGroup.size(); s++) {
+            const ObjFaceSpan& span = faceGroup[s];
+            const tinyobj::index_t* face = &span.chunk->corners[span.firstCorner];
+
+            for (size_t f = span.firstFace; f < span.firstFace + span.faceCount; f++) {
+                size_t faceSize = span.chunk->faceSizes[f];
+
+                if (triangulate) {
+                    // Polygon -> triangle fan conversion
+                    for (size_t k = 2; k < faceSize; k++) {
+                        shape->mesh.indices.push_back(face[0]);
+                        shape->mesh.indices.push_back(face[k - 1]);
+                        shape->mesh.indices.push_back(face[k]);
+                        shape->mesh.num_face_vertices.push_back(3);
+                        shape->mesh.material_ids.push_back(materialId);
+                    }
+                } else {
+                    shape->mesh.indices.insert(shape->mesh.indices.end(), face, face + faceSize);
+                    shape->mesh.num_face_vertices.push_back(static_cast<unsigned char>(faceSize));
+                    shape->mesh.material_ids.push_back(materialId);
+                }
+
+                face += faceSize;
+            }
+        }
+
+        shape->name = name;
+        shape->mesh.tags = tags;
+
+        return true;
+    }
+
+    bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+        std::vector<tinyobj::material_t>* materials, std::string* err,
+        const char* filename, const char* mtl_basepath, bool triangulate)
+    {
+        MappedFile file;
+        if (!file.Open(filename)) {
+            // missing or empty file - the reference parser reports both correctly
+            return tinyobj::LoadObj(attrib, shapes, materials, err, filename, mtl_basepath, triangulate);
+        }
+
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        const char* data = (const char*)file.GetData();
+        size_t size = file.GetSize();
+
+        // split into line-aligned chunks
+        ThreadPool& pool = ThreadPool::GetShared();
+        size_t chunkCount = std::min((size_t)pool.GetThreadCount() * 4, size / MIN_CHUNK_SIZE + 1);
+        std::vector<size_t> boundaries(chunkCount + 1, size);
+        boundaries[0] = 0;
+        for (size_t i = 1; i < chunkCount; i++) {
+            size_t target = std::max(size * i / chunkCount, boundaries[i - 1]);
+            const char* newline = (const char*)memchr(data + target, '\n', size - target);
+            boundaries[i] = newline ? (size_t)(newline - data) + 1 : size;
+        }
+
+        std::vector<ObjChunk> chunks(chunkCount);
+        if (chunkCount == 1) {
+            ParseChunk(data, data + size, &chunks[0]);
+        } else {
+            std::vector<std::future<void> > pending;
+            for (size_t i = 0; i < chunkCount; i++) {
+                const char* begin = data + boundaries[i];
+                const char* end = data + boundaries[i + 1];
+                ObjChunk* chunk = &chunks[i];
+                pending.push_back(pool.Submit([begin, end, chunk]() { ParseChunk(begin, end, chunk); }));
+            }
+            for (size_t i = 0; i < pending.size(); i++) {
+                pending[i].get();
+            }
+        }
+
+        // resolve relative indices and concatenate the attributes
+        size_t vertexFloats = 0, normalFloats = 0, texcoordFloats = 0;
+        for (size_t i = 0; i < chunkCount; i++) {
+            ObjChunk& chunk = chunks[i];
+            for (size_t r = 0; r < chunk.relativeCorners.size(); r++) {
+                tinyobj::index_t& corner = chunk.corners[chunk.relativeCorners[r].corner];
+                unsigned char mask = chunk.relativeCorners[r].mask;
+                if (mask & 1) corner.vertex_index += (int)(vertexFloats / 3);
+                if (mask & 2) corner.normal_index += (int)(normalFloats / 3);
+                if (mask & 4) corner.texcoord_index += (int)(texcoordFloats / 2);
+            }
+            vertexFloats += chunk.v.size();
+            normalFloats += chunk.vn.size();
+            texcoordFloats += chunk.vt.size();
+        }
+
+        attrib->vertices.reserve(vertexFloats);
+        attrib->normals.reserve(normalFloats);
+        attrib->texcoords.reserve(texcoordFloats);
+        for (size_t i = 0; i < chunkCount; i++) {
+            attrib->vertices.insert(attrib->vertices.end(), chunks[i].v.begin(), chunks[i].v.end());
+            attrib->normals.insert(attrib->normals.end(), chunks[i].vn.begin(), chunks[i].vn.end());
+            attrib->texcoords.insert(attrib->texcoords.end(), chunks[i].vt.begin(), chunks[i].vt.end());
+        }
+
+        // replay the statements in file order
+        std::string basePath = mtl_basepath ? mtl_basepath : "";
+        tinyobj::MaterialFileReader matFileReader(basePath);
+        std::map<std::string, int> material_map;
+        int material = -1;
+        std::string name;
+        std::vector<tinyobj::tag_t> tags;
+        std::vector<ObjFaceSpan> faceGroup;
+        tinyobj::shape_t shape;
+
+        for (size_t i = 0; i < chunkCount; i++) {
+            const ObjChunk& chunk = chunks[i];
+            size_t face = 0;
+            size_t corner = 0;
+
+            for (size_t c = 0; c <= chunk.commands.size(); c++) {
+                size_t nextFace = c < chunk.commands.size() ? chunk.commands[c].faceIndex : chunk.faceSizes.size();
+                if (nextFace > face) {
+                    ObjFaceSpan span = { &chunk, face, nextFace - face, corner };
+                    faceGroup.push_back(span);
+                    for (; face < nextFace; face++) {
+                        corner += chunk.faceSizes[face];
+                    }
+                }
+                if (c == chunk.commands.size()) {
+                    break;
+                }
+
+                const ObjCommand& command = chunk.commands[c];
+                switch (command.type) {
+                case OBJ_USEMTL: {
+                    int newMaterialId = -1;
+                    std::map<std::string, int>::const_iterator found = material_map.find(command.text);
+                    if (found != material_map.end()) {
+                        newMaterialId = found->second;
+                    }
+                    if (newMaterialId != material) {
+                        ExportFaceGroupToShape(&shape, faceGroup, tags, material, name, triangulate);
+                        faceGroup.clear();
+                        material = newMaterialId;
+                    }
+                    break;
+                }
+                case OBJ_MTLLIB: {
+                    std::string err_mtl;
+                    bool ok = matFileReader(command.text, materials, &material_map, &err_mtl);
+                    if (err) {
+                        (*err) += err_mtl;
+                    }
+                    if (!ok) {
+                        return false;
+                    }
+                    break;
+                }
+                case OBJ_GROUP:
+                case OBJ_OBJECT:
+                    if (ExportFaceGroupToShape(&shape, faceGroup, tags, material, name, triangulate)) {
+                        shapes->push_back(shape);
+                    }
+                    shape = tinyobj::shape_t();
+                    faceGroup.clear();
+                    name = command.text;
+                    break;
+                case OBJ_TAG:
+                    tags.push_back(ParseTag(command.text));
+                    break;
+                }
+            }
+        }
+
+        bool ret = ExportFaceGroupToShape(&shape, faceGroup, tags, material, name, triangulate);
+        if (ret || shape.mesh.indices.size()) {
+            shapes->push_back(shape);
+        }
+
+        return true;
+    }
+
+    static bool SameTag(const tinyobj::tag_t& a, const tinyobj::tag_t& b) {
+        return a.name == b.name && a.intValues == b.intValues &&
+            a.floatValues == b.floatValues && a.stringValues == b.stringValues;
+    }
+
+    static bool SameMaterial(const tinyobj::material_t& a, const tinyobj::material_t& b) {
+        for (int i = 0; i < 3; i++) {
+            if (a.ambient[i] != b.ambient[i] || a.diffuse[i] != b.diffuse[i] || a.specular[i] != b.specular[i] ||
+                a.transmittance[i] != b.transmittance[i] || a.emission[i] != b.emission[i]) {
+                return false;
+            }
+        }
+        return a.name == b.name && a.shininess == b.shininess && a.ior == b.ior &&
+            a.dissolve == b.dissolve && a.illum == b.illum &&
+            a.ambient_texname == b.ambient_texname && a.diffuse_texname == b.diffuse_texname &&
+            a.specular_texname == b.specular_texname && a.specular_highlight_texname == b.specular_highlight_texname &&
+            a.bump_texname == b.bump_texname && a.displacement_texname == b.displacement_texname &&
+            a.alpha_texname == b.alpha_texname && a.unknown_parameter == b.unknown_parameter;
+    }
+
+    bool CompareObjResults(const tinyobj::attrib_t& attribA, const std::vector<tinyobj::shape_t>& shapesA,
+        const std::vector<tinyobj::material_t>& materialsA,
+        const tinyobj::attrib_t& attribB, const std::vector<tinyobj::shape_t>& shapesB,
+        const std::vector<tinyobj::material_t>& materialsB, std::string* difference)
+    {
+        std::ostringstream message;
+
+        if (attribA.vertices != attribB.vertices) {
+            message << "vertex positions differ";
+        } else if (attribA.normals != attribB.normals) {
+            message << "normals differ";
+        } else if (attribA.texcoords != attribB.texcoords) {
+            message << "texture coordinates differ";
+        } else if (shapesA.size() != shapesB.size()) {
+            message << "shape count " << shapesA.size() << " != " << shapesB.size();
+        } else if (materialsA.size() != materialsB.size()) {
+            message << "material count " << materialsA.size() << " != " << materialsB.size();
+        } else {
+            for (size_t s = 0; s < shapesA.size() && message.tellp() == 0; s++) {
+                const tinyobj::mesh_t& a = shapesA[s].mesh;
+                const tinyobj::mesh_t& b = shapesB[s].mesh;
+
+                bool sameIndices = a.indices.size() == b.indices.size();
+                for (size_t i = 0; sameIndices && i < a.indices.size(); i++) {
+                    sameIndices = a.indices[i].vertex_index == b.indices[i].vertex_index &&
+                        a.indices[i].normal_index == b.indices[i].normal_index &&
+                        a.indices[i].texcoord_index == b.indices[i].texcoord_index;
+                }
+                bool sameTags = a.tags.size() == b.tags.size();
+                for (size_t i = 0; sameTags && i < a.tags.size(); i++) {
+                    sameTags = SameTag(a.tags[i], b.tags[i]);
+                }
+
+                if (shapesA[s].name != shapesB[s].name) {
+                    message << "shape " << s << " name '" << shapesA[s].name << "' != '" << shapesB[s].name << "'";
+                } else if (!sameIndices) {
+                    message << "shape " << s << " (" << shapesA[s].name << ") indices differ";
+                } else if (a.num_face_vertices != b.num_face_vertices) {
+                    message << "shape " << s << " (" << shapesA[s].name << ") face sizes differ";
+                } else if (a.material_ids != b.material_ids) {
+                    message << "shape " << s << " (" << shapesA[s].name << ") material ids differ";
+                } else if (!sameTags) {
+                    message << "shape " << s << " (" << shapesA[s].name << ") tags differ";
+                }
+            }
+            for (size_t m = 0; m < materialsA.size() && message.tellp() == 0; m++) {
+                if (!SameMaterial(materialsA[m], materialsB[m])) {
+                    message << "material " << m << " (" << materialsA[m].name << ") differs";
+                }
+            }
+        }
+
+        if (difference) {
+            *difference = message.str();
+        }
+        return message.tellp() == 0;
+    }
+}
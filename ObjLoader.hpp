@@ -0,0 +1,25 @@
+#ifndef ObjLoader_hpp
+#define ObjLoader_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Drop-in replacement for tinyobj::LoadObj(filename) that memory-maps the
+    // file, parses line-aligned chunks on the shared thread pool and merges the
+    // chunks in file order. Produces the same attrib/shape/material output.
+    bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+        std::vector<tinyobj::material_t>* materials, std::string* err,
+        const char* filename, const char* mtl_basepath = NULL, bool triangulate = true);
+
+    // Compares two parse results; describes the first difference in `difference`
+    bool CompareObjResults(const tinyobj::attrib_t& attribA, const std::vector<tinyobj::shape_t>& shapesA,
+        const std::vector<tinyobj::material_t>& materialsA,
+        const tinyobj::attrib_t& attribB, const std::vector<tinyobj::shape_t>& shapesB,
+        const std::vector<tinyobj::material_t>& materialsB, std::string* difference);
+}
+
+#endif /* ObjLoader_hpp */
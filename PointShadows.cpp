@@ -0,0 +1,277 @@
+#include "PointShadows.hpp"
+
+#include "GLStateCache.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    // cube face directions and up vectors, in GL cube map order (+X, -X, +Y, -Y, +Z, -Z);
+    // basic.frag picks the face and its coordinates with the same table
+    static const glm::vec3 FACE_FORWARD[6] = {
+        glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+    };
+    static const glm::vec3 FACE_UP[6] = {
+        glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+    };
+
+    static const float NEAR_PLANE = 0.05f;
+
+    PointShadowAtlas& PointShadowAtlas::GetInstance()
+    {
+        static PointShadowAtlas instance;
+        return instance;
+    }
+
+    PointShadowAtlas::PointShadowAtlas()
+        : size(0), texture(0), framebuffer(0), staticTexture(0), staticFramebuffer(0), frame(0)
+    {
+        statistics = { 0, 0, 0, 0, 0 };
+    }
+
+    bool PointShadowAtlas::Init(GLsizei atlasSize)
+    {
+        size = atlasSize;
+        if (!CreateAtlas(texture, framebuffer) || !CreateAtlas(staticTexture, staticFramebuffer)) {
+            fprintf(stderr, "Point shadow atlas framebuffer is incomplete\n");
+            return false;
+        }
+
+        shader.loadLayeredShader("shaders/pointShadow.vert", "shaders/pointShadow.geom", "shaders/pointShadow.frag");
+        return true;
+    }
+
+    bool PointShadowAtlas::CreateAtlas(GLuint& atlasTexture, GLuint& atlasFramebuffer)
+    {
+        glGenTextures(1, &atlasTexture);
+        glBindTexture(GL_TEXTURE_2D, atlasTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &atlasFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, atlasFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, atlasTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // the raw binds above went around the state cache
+        GLStateCache::GetInstance().Invalidate();
+        return complete;
+    }
+
+    size_t PointShadowAtlas::AddLight(const glm::vec3& position, float range)
+    {
+        Light light;
+        light.position = position;
+        light.range = range;
+        light.enabled = true;
+        light.requested = 0;
+        light.faceSize = 0;
+        light.x = light.y = 0;
+        light.dirty = true;
+        light.due = false;
+        lights.push_back(light);
+        return lights.size() - 1;
+    }
+
+    void PointShadowAtlas::SetLight(size_t index, const glm::vec3& position, float range, bool enabled)
+    {
+        Light& light = lights[index];
+        if (light.position != position || light.range != range || light.enabled != enabled) {
+            light.dirty = true;
+        }
+        light.position = position;
+        light.range = range;
+        light.enabled = enabled;
+    }
+
+    void PointShadowAtlas::Update(const glm::vec3& eye, float pixelsPerUnit)
+    {
+        frame++;
+        for (size_t i = 0; i < lights.size(); i++) {
+            Light& light = lights[i];
+            GLsizei faceSize = 0;
+            if (light.enabled) {
+                // radius of the reach on screen, about one face texel per two pixels of it
+                float distance = glm::length(light.position - eye);
+                float pixels = distance > light.range
+                    ? light.range * pixelsPerUnit / std::sqrt(distance * distance - light.range * light.range)
+                    : (float)MAX_FACE_SIZE * 2.0f;
+                faceSize = MIN_FACE_SIZE;
+                while (faceSize < MAX_FACE_SIZE && faceSize * 2 < pixels) {
+                    faceSize *= 2;
+                }
+            }
+            light.requested = faceSize;
+            light.due = false;
+        }
+
+        Pack();
+
+        statistics.lights = lights.size();
+        statistics.shadowed = 0;
+        statistics.usedTexels = 0;
+        for (size_t i = 0; i < lights.size(); i++) {
+            Light& light = lights[i];
+            if (light.faceSize == 0) {
+                continue;
+            }
+            statistics.shadowed++;
+            statistics.usedTexels += (size_t)6 * light.faceSize * light.faceSize;
+            // the biggest tiles every frame, each halving every other frame as often,
+            // staggered by index so the redraws spread over the frames
+            unsigned int interval = (unsigned int)(MAX_FACE_SIZE / light.faceSize);
+            light.due = light.dirty || (frame + (unsigned int)i) % interval == 0;
+        }
+    }
+
+    void PointShadowAtlas::Pack()
+    {
+        std::vector<size_t> order;
+        for (size_t i = 0; i < lights.size(); i++) {
+            if (lights[i].requested > 0) {
+                order.push_back(i);
+            } else if (lights[i].faceSize > 0) {
+                lights[i].faceSize = 0;
+                lights[i].dirty = true;
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return lights[a].requested > lights[b].requested;
+        });
+
+        // when the requests add up to more than the shelves can hold, the largest
+        // tiles shrink first so every light keeps a shadow as long as possible
+        std::vector<GLsizei> faceSizes(order.size());
+        size_t area = 0;
+        for (size_t i = 0; i < order.size(); i++) {
+            faceSizes[i] = lights[order[i]].requested;
+            area += (size_t)6 * faceSizes[i] * faceSizes[i];
+        }
+        size_t budget = (size_t)size * size * 3 / 4;
+        while (area > budget && !faceSizes.empty() && faceSizes[0] > MIN_FACE_SIZE) {
+            // one light at a time, the last of the largest, so the list stays sorted
+            size_t last = 0;
+            while (last + 1 < faceSizes.size() && faceSizes[last + 1] == faceSizes[0]) {
+                last++;
+            }
+            faceSizes[last] /= 2;
+            area -= (size_t)6 * 3 * faceSizes[last] * faceSizes[last];
+        }
+
+        GLint x = 0, y = 0, shelfHeight = 0;
+        for (size_t i = 0; i < order.size(); i++) {
+            Light& light = lights[order[i]];
+            GLsizei faceSize = faceSizes[i];
+            GLint tileX = 0, tileY = 0;
+            bool placed = false;
+            while (!placed && faceSize >= MIN_FACE_SIZE) {
+                GLint width = 3 * faceSize, height = 2 * faceSize;
+                GLint shelfX = x, shelfY = y, shelf = shelfHeight;
+                if (shelfX + width > size) {
+                    shelfY += shelf;
+                    shelfX = 0;
+                    shelf = 0;
+                }
+                if (shelfY + height <= size) {
+                    tileX = shelfX;
+                    tileY = shelfY;
+                    x = shelfX + width;
+                    y = shelfY;
+                    shelfHeight = std::max(shelf, height);
+                    placed = true;
+                } else {
+                    faceSize /= 2;
+                }
+            }
+            if (!placed) {
+                faceSize = 0;
+            }
+            if (faceSize != light.faceSize || tileX != light.x || tileY != light.y) {
+                light.dirty = true;
+            }
+            light.faceSize = faceSize;
+            light.x = tileX;
+            light.y = tileY;
+        }
+    }
+
+    void PointShadowAtlas::Render(const std::function<void(const Shader& shader, const glm::vec3& center, float radius,
+        bool staticCasters)>& drawCasters)
+    {
+        statistics.rendered = 0;
+        statistics.staticRendered = 0;
+        GLStateCache& state = GLStateCache::GetInstance();
+        for (size_t i = 0; i < lights.size(); i++) {
+            Light& light = lights[i];
+            if (!light.due) {
+                continue;
+            }
+            if (statistics.rendered == 0) {
+                shader.useShaderProgram();
+            }
+            statistics.rendered++;
+
+            glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, NEAR_PLANE, light.range);
+            glm::mat4 faceViewProjection[6];
+            for (int f = 0; f < 6; f++) {
+                glViewportIndexedf(1 + f, (GLfloat)(light.x + (f % 3) * light.faceSize), (GLfloat)(light.y + (f / 3) * light.faceSize),
+                    (GLfloat)light.faceSize, (GLfloat)light.faceSize);
+                glm::mat4 view = glm::lookAt(light.position, light.position + FACE_FORWARD[f], FACE_UP[f]);
+                faceViewProjection[f] = projection * view;
+            }
+            shader.setMat4Array("faceViewProjection", faceViewProjection, 6);
+            shader.setVec3("lightPosition", light.position);
+            shader.setFloat("lightRange", light.range);
+
+            GLint width = 3 * light.faceSize, height = 2 * light.faceSize;
+            if (light.dirty) {
+                // only this light's tile is cleared, the others keep their last draw
+                statistics.staticRendered++;
+                state.BindFramebuffer(staticFramebuffer);
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(light.x, light.y, width, height);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                glDisable(GL_SCISSOR_TEST);
+                drawCasters(shader, light.position, light.range, true);
+                light.dirty = false;
+            }
+
+            // the state cache binds both targets, so the read side is put back after the copy
+            state.BindFramebuffer(framebuffer);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+            glBlitFramebuffer(light.x, light.y, light.x + width, light.y + height, light.x, light.y, light.x + width, light.y + height,
+                GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+            drawCasters(shader, light.position, light.range, false);
+        }
+    }
+
+    glm::vec4 PointShadowAtlas::GetShadowTile(size_t index) const
+    {
+        const Light& light = lights[index];
+        if (light.faceSize == 0) {
+            return glm::vec4(0.0f, 0.0f, 0.0f, light.range);
+        }
+        return glm::vec4((float)light.x / size, (float)light.y / size, (float)light.faceSize / size, light.range);
+    }
+
+    GLuint PointShadowAtlas::GetTexture() const
+    {
+        return texture;
+    }
+
+    PointShadowStatistics PointShadowAtlas::GetStatistics() const
+    {
+        return statistics;
+    }
+}
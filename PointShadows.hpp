@@ -0,0 +1,102 @@
+#ifndef PointShadows_hpp
+#define PointShadows_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace gps {
+
+    // Lights in the atlas and the work done for them during the last Update/Render
+    struct PointShadowStatistics
+    {
+        size_t lights;
+        size_t shadowed;    // lights that got a tile
+        size_t rendered;    // lights redrawn this frame, six faces each
+        size_t staticRendered;  // of which the static casters were redrawn too
+        size_t usedTexels;  // atlas area covered by tiles
+    };
+
+    // Omnidirectional shadows for point lights, all in one depth atlas. Each light gets
+    // a tile of six cube faces (three across, two down) whose size follows how much of
+    // the screen its reach covers; smaller tiles are also redrawn less often. A light is
+    // drawn in one pass: a geometry shader sends every triangle to the six face
+    // viewports (1..6 of the viewport array, 0 is left to everything else) and writes
+    // the distance to the light divided by its range as the depth. Static casters are
+    // kept in a second atlas of the same layout and drawn only when a light's tile,
+    // position or range changes; a redraw copies its tile and adds the moving casters.
+    class PointShadowAtlas
+    {
+    public:
+        static PointShadowAtlas& GetInstance();
+
+        // Creates the size x size atlas and loads the shaders, false if the framebuffer is incomplete
+        bool Init(GLsizei size);
+
+        // Returns the light's index for SetLight and GetShadowTile
+        size_t AddLight(const glm::vec3& position, float range);
+        // Lights that are off keep their index but give up their tile
+        void SetLight(size_t light, const glm::vec3& position, float range, bool enabled);
+
+        // Sizes the tiles from the screen coverage seen from eye (pixelsPerUnit is the
+        // size in pixels of one unit at distance one), packs the atlas and decides which
+        // lights are redrawn this frame. Call once per frame before Render.
+        void Update(const glm::vec3& eye, float pixelsPerUnit);
+
+        // Redraws the lights Update picked; drawCasters draws the static or the moving
+        // casters within radius of center with the shader given, setting its "model" uniform
+        void Render(const std::function<void(const Shader& shader, const glm::vec3& center, float radius,
+            bool staticCasters)>& drawCasters);
+
+        // Tile of the light in texture coordinates: xy origin, z face size, w range;
+        // z is 0 when the light has no shadow
+        glm::vec4 GetShadowTile(size_t light) const;
+        GLuint GetTexture() const;
+
+        PointShadowStatistics GetStatistics() const;
+
+        // face sizes, in texels
+        static const GLsizei MAX_FACE_SIZE = 512;
+        static const GLsizei MIN_FACE_SIZE = 64;
+
+    private:
+        struct Light
+        {
+            glm::vec3 position;
+            float range;
+            bool enabled;
+            GLsizei requested;    // face size the screen coverage asks for, 0 when off
+            GLsizei faceSize;     // what the atlas had room for, 0 without a tile
+            GLint x, y;           // tile origin in texels
+            bool dirty;           // tile, position or range changed since the last draw
+            bool due;             // redrawn by the next Render
+        };
+
+        std::vector<Light> lights;
+        GLsizei size;
+        GLuint texture;
+        GLuint framebuffer;
+        // static casters only, copied into texture before the moving ones are added
+        GLuint staticTexture;
+        GLuint staticFramebuffer;
+        Shader shader;
+        unsigned int frame;
+        PointShadowStatistics statistics;
+
+        PointShadowAtlas();
+
+        // Depth texture and framebuffer of one size x size atlas, false if incomplete
+        bool CreateAtlas(GLuint& atlasTexture, GLuint& atlasFramebuffer);
+
+        // Shrinks the largest requests to the atlas budget, then places the tiles
+        // largest first on shelves, halving a light's tile until it fits
+        void Pack();
+    };
+}
+
+#endif /* PointShadows_hpp */
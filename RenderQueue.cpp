@@ -0,0 +1,195 @@
+#include "RenderQueue.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    RenderQueue::RenderQueue()
+    {
+        statistics.draws = 0;
+        statistics.unsortedChanges = 0;
+        statistics.sortedChanges = 0;
+    }
+
+    RenderQueue& RenderQueue::GetInstance()
+    {
+        static RenderQueue instance;
+        return instance;
+    }
+
+    void RenderQueue::SetPassSetup(RenderPass pass, std::function<void()> setup)
+    {
+        passSetup[pass] = setup;
+    }
+
+    size_t RenderQueue::AddTransform(const glm::mat4& model, const glm::mat3& normalMatrix, const glm::vec4& texCoordDecode)
+    {
+        Transform transform;
+        transform.model = model;
+        transform.normalMatrix = normalMatrix;
+        transform.texCoordDecode = texCoordDecode;
+        transforms.push_back(transform);
+        return transforms.size() - 1;
+    }
+
+    void RenderQueue::Submit(RenderPass pass, const Shader& shader, const Mesh* textures, GLuint material,
+        const MultiDrawBatch& draws, size_t transform, float depth)
+    {
+        if (!textures) {
+            material = 0;
+        }
+
+        Item item;
+        item.key = ((uint64_t)pass << PASS_SHIFT)
+            | ((uint64_t)(shader.shaderProgram & 0xff) << SHADER_SHIFT)
+            | ((uint64_t)(material & 0xfffff) << MATERIAL_SHIFT)
+            | DepthBits(depth);
+        item.shader = &shader;
+        item.textures = textures;
+        item.draws = &draws;
+        item.transform = transform;
+        items.push_back(item);
+    }
+
+    uint32_t RenderQueue::DepthBits(float depth)
+    {
+        // behind the camera sorts first, like depth 0
+        if (!(depth > 0.0f)) {
+            return 0;
+        }
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits;
+    }
+
+    void RenderQueue::RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+    {
+        if (entries.empty()) {
+            return;
+        }
+        scratch.resize(entries.size());
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = { 0 };
+            for (size_t i = 0; i < entries.size(); i++) {
+                counts[(entries[i].key >> shift) & 0xff]++;
+            }
+            if (counts[(entries[0].key >> shift) & 0xff] == entries.size()) {
+                continue;
+            }
+
+            size_t offset = 0;
+            for (int b = 0; b < 256; b++) {
+                size_t count = counts[b];
+                counts[b] = offset;
+                offset += count;
+            }
+            for (size_t i = 0; i < entries.size(); i++) {
+                scratch[counts[(entries[i].key >> shift) & 0xff]++] = entries[i];
+            }
+            entries.swap(scratch);
+        }
+    }
+
+    size_t RenderQueue::CountChanges(const std::vector<SortEntry>& order) const
+    {
+        size_t changes = 0;
+        const Item* previous = NULL;
+        for (size_t i = 0; i < order.size(); i++) {
+            const Item& item = items[order[i].item];
+            bool newShader = !previous || previous->shader != item.shader;
+            GLuint material = (GLuint)(item.key >> MATERIAL_SHIFT) & 0xfffff;
+            GLuint previousMaterial = previous ? (GLuint)(previous->key >> MATERIAL_SHIFT) & 0xfffff : 0;
+            changes += newShader;
+            changes += item.textures && (newShader || material != previousMaterial);
+            changes += newShader || previous->transform != item.transform;
+            previous = &item;
+        }
+        return changes;
+    }
+
+    void RenderQueue::Flush()
+    {
+        sorted.resize(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            sorted[i].key = items[i].key;
+            sorted[i].item = (uint32_t)i;
+        }
+        statistics.draws += items.size();
+        statistics.unsortedChanges += CountChanges(sorted);
+        RadixSort(sorted, scratch);
+        statistics.sortedChanges += CountChanges(sorted);
+
+        GeometryArena& arena = GeometryArena::GetInstance();
+        int pass = -1;
+        const Shader* shader = NULL;
+        uint64_t material = 0;
+        size_t transform = 0;
+        for (size_t i = 0; i < sorted.size(); i++) {
+            const Item& item = items[sorted[i].item];
+
+            int itemPass = (int)(item.key >> PASS_SHIFT);
+            if (itemPass != pass) {
+                while (pass < itemPass) {
+                    pass++;
+                    if (passSetup[pass]) {
+                        passSetup[pass]();
+                    }
+                }
+                shader = NULL;
+            }
+            // uniforms and sampler units belong to the program, so a new one starts over
+            bool newShader = item.shader != shader;
+            if (newShader) {
+                shader = item.shader;
+                shader->useShaderProgram();
+            }
+            if (newShader || item.transform != transform) {
+                transform = item.transform;
+                shader->setMat4("model", transforms[transform].model);
+                shader->setMat3("normalMatrix", transforms[transform].normalMatrix);
+                shader->setVec4("texCoordDecode", transforms[transform].texCoordDecode);
+            }
+            uint64_t itemMaterial = (item.key >> MATERIAL_SHIFT) & 0xfffff;
+            if (item.textures && (newShader || itemMaterial != material)) {
+                item.textures->BindTextures(*shader);
+            }
+            material = itemMaterial;
+
+            arena.MultiDraw(*item.draws);
+        }
+        while (pass + 1 < RENDER_PASS_COUNT) {
+            pass++;
+            if (passSetup[pass]) {
+                passSetup[pass]();
+            }
+        }
+
+        items.clear();
+        transforms.clear();
+    }
+
+    GLuint RenderQueue::GetMaterialId(const std::vector<Texture>& textures)
+    {
+        static std::unordered_map<std::string, GLuint> materials;
+        if (textures.empty()) {
+            return 0;
+        }
+
+        std::string key;
+        for (size_t i = 0; i < textures.size(); i++) {
+            key += textures[i].type + ":" + std::to_string(textures[i].id) + ";";
+        }
+        std::unordered_map<std::string, GLuint>::iterator found = materials.find(key);
+        if (found != materials.end()) {
+            return found->second;
+        }
+        GLuint id = (GLuint)materials.size() + 1;
+        materials[key] = id;
+        return id;
+    }
+
+    RenderQueueStatistics RenderQueue::GetStatistics() const
+    {
+        return statistics;
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GeometryArena.hpp"
+#include "Mesh.hpp"
+#include "Shader.hpp"
+#include "ShadowCascades.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    // Drawn in this order: per cascade the cached static casters, then the copy of them
+    // plus the moving casters; static casters only go in when their cache is rebuilt
+    enum RenderPass { STATIC_SHADOW_PASS = 0, SHADOW_PASS = 1, MAIN_PASS = 2 * SHADOW_CASCADE_COUNT };
+
+    static const int RENDER_PASS_COUNT = MAIN_PASS + 1;
+
+    inline RenderPass StaticShadowPass(int cascade) { return (RenderPass)(STATIC_SHADOW_PASS + 2 * cascade); }
+    inline RenderPass ShadowPass(int cascade) { return (RenderPass)(SHADOW_PASS + 2 * cascade); }
+
+    // Submitted draws and the program/texture/transform switches they needed
+    // in submission order versus sorted order, since startup
+    struct RenderQueueStatistics
+    {
+        size_t draws;
+        size_t unsortedChanges;
+        size_t sortedChanges;
+    };
+
+    // Collects the draws of a frame under 64-bit sort keys, radix sorts them
+    // and walks them in key order so program and texture switches are only
+    // made when the key actually changes. Key layout, high to low bits:
+    // pass (4) | shader (8) | material (20) | depth (32).
+    class RenderQueue
+    {
+    public:
+        static RenderQueue& GetInstance();
+
+        // Called on every flush when the walk reaches pass, before its first draw; passes
+        // with nothing to draw still get it, so they can prepare their targets regardless
+        void SetPassSetup(RenderPass pass, std::function<void()> setup);
+
+        // Stores a model/normal matrix pair and the texture coordinate decode of the
+        // model's vertices for this frame, returns its index
+        size_t AddTransform(const glm::mat4& model, const glm::mat3& normalMatrix, const glm::vec4& texCoordDecode);
+
+        // textures may be NULL for passes that do not sample them (e.g. depth only)
+        void Submit(RenderPass pass, const Shader& shader, const Mesh* textures, GLuint material,
+            const MultiDrawBatch& draws, size_t transform, float depth);
+
+        // Sorts and draws everything submitted since the last flush
+        void Flush();
+
+        // Small id shared by every mesh with the same texture set, 0 is "no textures"
+        static GLuint GetMaterialId(const std::vector<Texture>& textures);
+
+        RenderQueueStatistics GetStatistics() const;
+
+    private:
+        static const int PASS_SHIFT = 60;
+        static const int SHADER_SHIFT = 52;
+        static const int MATERIAL_SHIFT = 32;
+
+        struct Transform
+        {
+            glm::mat4 model;
+            glm::mat3 normalMatrix;
+            glm::vec4 texCoordDecode;
+        };
+
+        struct Item
+        {
+            uint64_t key;
+            const Shader* shader;
+            const Mesh* textures;
+            const MultiDrawBatch* draws;
+            size_t transform;
+        };
+
+        // Key plus the item it belongs to, what the radix sort moves around
+        struct SortEntry
+        {
+            uint64_t key;
+            uint32_t item;
+        };
+
+        std::vector<Item> items;
+        std::vector<Transform> transforms;
+        std::vector<SortEntry> sorted;
+        std::vector<SortEntry> scratch;
+        std::function<void()> passSetup[RENDER_PASS_COUNT];
+
+        RenderQueueStatistics statistics;
+
+        RenderQueue();
+
+        // LSD radix sort, 8 bits per pass, skipping bytes every key shares
+        static void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+        // Float to unsigned with the same ordering for non-negative values
+        static uint32_t DepthBits(float depth);
+        // Switches a walk in this order would make
+        size_t CountChanges(const std::vector<SortEntry>& order) const;
+    };
+}
+
+#endif /* RenderQueue_hpp */
@@ -1,6 +1,14 @@
 #include "Shader.hpp"
+#include "GLStateCache.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <vector>
 
 namespace gps {
+
+    static UniformStatistics uniformStatistics = { 0, 0 };
     std::string Shader::readShaderFile(std::string fileName)
     {
         std::ifstream shaderFile;
@@ -49,27 +57,42 @@ namespace gps {
         }
     }
 
+    std::string Shader::insertDefines(const std::string& source, const std::string& defines)
+    {
+        if (defines.empty()) {
+            return source;
+        }
+        // #version has to stay the first statement
+        size_t version = source.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos) {
+            return defines + "\n" + source;
+        }
+        // #line keeps the compile log's line numbers those of the file
+        return source.substr(0, lineEnd + 1) + defines + "\n#line 2\n" + source.substr(lineEnd + 1);
+    }
+
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
     {
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
-
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
+        loadShader(vertexShaderFileName, fragmentShaderFileName, std::string());
+    }
+
+    GLuint Shader::compileStage(GLenum type, const std::string& source)
+    {
+        const GLchar* sourceString = source.c_str();
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &sourceString, NULL);
+        glCompileShader(shader);
         //check compilation status
-        shaderCompileLog(fragmentShader);
+        shaderCompileLog(shader);
+        return shader;
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::string& defines)
+    {
+        //read, parse and compile the vertex and fragment shaders
+        GLuint vertexShader = compileStage(GL_VERTEX_SHADER, insertDefines(readShaderFile(vertexShaderFileName), defines));
+        GLuint fragmentShader = compileStage(GL_FRAGMENT_SHADER, insertDefines(readShaderFile(fragmentShaderFileName), defines));
 
         //attach and link the shader programs
         this->shaderProgram = glCreateProgram();
@@ -80,11 +103,141 @@ namespace gps {
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+
+        introspectUniforms();
+    }
+
+    void Shader::loadLayeredShader(std::string vertexShaderFileName, std::string geometryShaderFileName,
+        std::string fragmentShaderFileName)
+    {
+        GLuint vertexShader = compileStage(GL_VERTEX_SHADER, readShaderFile(vertexShaderFileName));
+        GLuint geometryShader = compileStage(GL_GEOMETRY_SHADER, readShaderFile(geometryShaderFileName));
+        GLuint fragmentShader = compileStage(GL_FRAGMENT_SHADER, readShaderFile(fragmentShaderFileName));
+
+        this->shaderProgram = glCreateProgram();
+        glAttachShader(this->shaderProgram, vertexShader);
+        glAttachShader(this->shaderProgram, geometryShader);
+        glAttachShader(this->shaderProgram, fragmentShader);
+        glLinkProgram(this->shaderProgram);
+        glDeleteShader(vertexShader);
+        glDeleteShader(geometryShader);
+        glDeleteShader(fragmentShader);
+        shaderLinkLog(this->shaderProgram);
+
+        introspectUniforms();
+    }
+
+    void Shader::introspectUniforms()
+    {
+        uniformLocations.clear();
+
+        GLint uniformCount = 0, maxNameLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        std::vector<GLchar> nameBuffer(std::max(maxNameLength, 1));
+
+        for (GLint i = 0; i < uniformCount; i++) {
+            GLint size;
+            GLenum type;
+            GLsizei length;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, &nameBuffer[0]);
+            std::string name(&nameBuffer[0], length);
+
+            GLint location = glGetUniformLocation(this->shaderProgram, name.c_str());
+            uniformStatistics.driverLookups++;
+            if (location < 0) {
+                continue; // uniform block members have no location
+            }
+            uniformLocations[name] = location;
+
+            // arrays are reported once as "name[0]"; make "name" and every "name[i]" work as well
+            size_t bracket = name.find('[');
+            if (bracket != std::string::npos) {
+                std::string base = name.substr(0, bracket);
+                uniformLocations[base] = location;
+                for (GLint element = 1; element < size; element++) {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    GLint elementLocation = glGetUniformLocation(this->shaderProgram, elementName.c_str());
+                    uniformStatistics.driverLookups++;
+                    if (elementLocation >= 0) {
+                        uniformLocations[elementName] = elementLocation;
+                    }
+                }
+            }
+        }
+    }
+
+    void Shader::useShaderProgram() const
+    {
+        GLStateCache::GetInstance().UseProgram(this->shaderProgram);
+    }
+
+    GLint Shader::getUniformLocation(const std::string& name) const
+    {
+        uniformStatistics.cachedLookups++;
+        std::unordered_map<std::string, GLint>::const_iterator found = uniformLocations.find(name);
+        return found != uniformLocations.end() ? found->second : -1;
+    }
+
+    void Shader::setInt(const std::string& name, GLint value) const
+    {
+        GLint location = getUniformLocation(name);
+        if (location >= 0) {
+            glUniform1i(location, value);
+        }
+    }
+
+    void Shader::setFloat(const std::string& name, GLfloat value) const
+    {
+        GLint location = getUniformLocation(name);
+        if (location >= 0) {
+            glUniform1f(location, value);
+        }
+    }
+
+    void Shader::setVec3(const std::string& name, const glm::vec3& value) const
+    {
+        GLint location = getUniformLocation(name);
+        if (location >= 0) {
+            glUniform3fv(location, 1, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::setVec4(const std::string& name, const glm::vec4& value) const
+    {
+        GLint location = getUniformLocation(name);
+        if (location >= 0) {
+            glUniform4fv(location, 1, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::setMat3(const std::string& name, const glm::mat3& value) const
+    {
+        GLint location = getUniformLocation(name);
+        if (location >= 0) {
+            glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::setMat4(const std::string& name, const glm::mat4& value) const
+    {
+        GLint location = getUniformLocation(name);
+        if (location >= 0) {
+            glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::setMat4Array(const std::string& name, const glm::mat4* values, GLsizei count) const
+    {
+        GLint location = getUniformLocation(name);
+        if (location >= 0) {
+            glUniformMatrix4fv(location, count, GL_FALSE, glm::value_ptr(values[0]));
+        }
     }
 
-    void Shader::useShaderProgram()
+    UniformStatistics Shader::getUniformStatistics()
     {
-        glUseProgram(this->shaderProgram);
+        return uniformStatistics;
     }
 
 }
@@ -2,26 +2,62 @@
 #define Shader_hpp
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <unordered_map>
 
 namespace gps {
 
+// Uniform lookups since startup, to tell how many happen per frame
+struct UniformStatistics
+{
+    size_t driverLookups; // glGetUniformLocation calls
+    size_t cachedLookups; // name lookups served by the location tables
+};
+
 class Shader
 {
 public:
     GLuint shaderProgram;
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
-    void useShaderProgram();
+    // Variant of the same sources: defines ("#define NAME value" lines) go right
+    // after the #version line of both stages
+    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::string& defines);
+    // With a geometry stage in between, for layered and multi-viewport rendering
+    void loadLayeredShader(std::string vertexShaderFileName, std::string geometryShaderFileName,
+        std::string fragmentShaderFileName);
+    void useShaderProgram() const;
+
+    // Location of an active uniform from the table filled after linking, -1 if
+    // the program has no such uniform (e.g. optimized out)
+    GLint getUniformLocation(const std::string& name) const;
+
+    // Setters for the program in use; uniforms the program lacks are skipped
+    void setInt(const std::string& name, GLint value) const;
+    void setFloat(const std::string& name, GLfloat value) const;
+    void setVec3(const std::string& name, const glm::vec3& value) const;
+    void setVec4(const std::string& name, const glm::vec4& value) const;
+    void setMat3(const std::string& name, const glm::mat3& value) const;
+    void setMat4(const std::string& name, const glm::mat4& value) const;
+    // A whole uniform array from its first element on, in one call
+    void setMat4Array(const std::string& name, const glm::mat4* values, GLsizei count) const;
+
+    static UniformStatistics getUniformStatistics();
 
 private:
+    std::unordered_map<std::string, GLint> uniformLocations;
+
     std::string readShaderFile(std::string fileName);
+    static std::string insertDefines(const std::string& source, const std::string& defines);
+    GLuint compileStage(GLenum type, const std::string& source);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
+    void introspectUniforms();
 };
 
 }
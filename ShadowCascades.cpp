@@ -0,0 +1,141 @@
+#include "ShadowCascades.hpp"
+
+#include "Culling.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace gps {
+
+    void ComputeCascadeSplits(float nearPlane, float farPlane, float lambda, float* splits)
+    {
+        splits[0] = nearPlane;
+        for (int i = 1; i <= SHADOW_CASCADE_COUNT; i++) {
+            float fraction = (float)i / SHADOW_CASCADE_COUNT;
+            float logarithmic = nearPlane * std::pow(farPlane / nearPlane, fraction);
+            float uniform = nearPlane + (farPlane - nearPlane) * fraction;
+            splits[i] = lambda * logarithmic + (1.0f - lambda) * uniform;
+        }
+    }
+
+    // Grows [low, high] to a whole number of steps starting on a texel of the resulting
+    // size, returns that texel size
+    static float SnapRange(float& low, float& high, float step, int resolution)
+    {
+        float size = std::max(std::ceil((high - low) / step), 1.0f) * step;
+        for (;;) {
+            float texel = size / resolution;
+            float snapped = std::floor(low / texel) * texel;
+            if (snapped + size >= high) {
+                low = snapped;
+                high = snapped + size;
+                return texel;
+            }
+            size += step;
+        }
+    }
+
+    ShadowCascade FitCascade(const glm::mat4& inverseView, float fovy, float aspect, float nearDistance,
+        float farDistance, const glm::vec3& lightDirection, int resolution, const Bounds* boxes, size_t boxCount,
+        int marginSteps)
+    {
+        // the light view only depends on the direction, so snapping in it is stable
+        glm::vec3 direction = glm::normalize(lightDirection);
+        glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), -direction, up);
+        glm::mat4 toLight = lightView * inverseView;
+
+        // slice corners in light space, their box and bounding sphere
+        float tanY = std::tan(fovy * 0.5f);
+        float tanX = tanY * aspect;
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        glm::vec3 sliceMin(FLT_MAX), sliceMax(-FLT_MAX);
+        for (int i = 0; i < 8; i++) {
+            float distance = (i & 4) ? farDistance : nearDistance;
+            glm::vec4 corner((i & 1 ? 1.0f : -1.0f) * tanX * distance, (i & 2 ? 1.0f : -1.0f) * tanY * distance, -distance, 1.0f);
+            corners[i] = glm::vec3(toLight * corner);
+            center += corners[i];
+            sliceMin = glm::min(sliceMin, corners[i]);
+            sliceMax = glm::max(sliceMax, corners[i]);
+        }
+        center /= 8.0f;
+
+        float radius = 0.0f;
+        for (int i = 0; i < 8; i++) {
+            radius = std::max(radius, glm::length(corners[i] - center));
+        }
+        // rounding absorbs float noise, so the steps stay exactly the same
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+        float step = 2.0f * radius / SHADOW_FIT_STEPS;
+
+        // receivers: the boxes clipped to the slice, limited to the sphere across the light
+        glm::mat3 rotation(lightView);
+        glm::mat3 absolute(glm::abs(rotation[0]), glm::abs(rotation[1]), glm::abs(rotation[2]));
+        glm::vec3 receiverMin(FLT_MAX), receiverMax(-FLT_MAX);
+        for (size_t i = 0; i < boxCount; i++) {
+            glm::vec3 boxCenter = rotation * ((boxes[i].min + boxes[i].max) * 0.5f);
+            glm::vec3 boxExtent = absolute * ((boxes[i].max - boxes[i].min) * 0.5f);
+            glm::vec3 low = glm::max(boxCenter - boxExtent, sliceMin);
+            glm::vec3 high = glm::min(boxCenter + boxExtent, sliceMax);
+            if (low.x <= high.x && low.y <= high.y && low.z <= high.z) {
+                receiverMin = glm::min(receiverMin, low);
+                receiverMax = glm::max(receiverMax, high);
+            }
+        }
+        glm::vec3 low = glm::max(receiverMin, center - radius);
+        glm::vec3 high = glm::min(receiverMax, center + radius);
+        if (!(low.x <= high.x && low.y <= high.y && low.z <= high.z)) {
+            // nothing in the slice to receive shadows, any small valid box will do
+            low = center;
+            high = center;
+        }
+        low -= glm::vec3(marginSteps * step);
+        high += glm::vec3(marginSteps * step);
+
+        ShadowCascade cascade;
+        cascade.nearDistance = nearDistance;
+        cascade.farDistance = farDistance;
+        cascade.sphereTexelSize = 2.0f * radius / resolution;
+        float texelX = SnapRange(low.x, high.x, step, resolution);
+        float texelY = SnapRange(low.y, high.y, step, resolution);
+        cascade.texelSize = std::max(texelX, texelY);
+
+        // casters: anything over the receiver area, up to the highest one towards the light
+        for (size_t i = 0; i < boxCount; i++) {
+            glm::vec3 boxCenter = rotation * ((boxes[i].min + boxes[i].max) * 0.5f);
+            glm::vec3 boxExtent = absolute * ((boxes[i].max - boxes[i].min) * 0.5f);
+            glm::vec3 boxMin = boxCenter - boxExtent;
+            glm::vec3 boxMax = boxCenter + boxExtent;
+            if (boxMin.x <= high.x && boxMax.x >= low.x && boxMin.y <= high.y && boxMax.y >= low.y && boxMax.z >= low.z) {
+                high.z = std::max(high.z, boxMax.z);
+            }
+        }
+        low.z = std::floor(low.z / step) * step;
+        high.z = std::max(std::ceil(high.z / step) * step, low.z + step);
+
+        // the light looks down -z, so the planes are at -high.z (near) and -low.z (far)
+        glm::mat4 lightProjection = glm::ortho(low.x, high.x, low.y, high.y, -high.z, -low.z);
+        cascade.lightSpace = lightProjection * lightView;
+        cascade.boundsMin = low;
+        cascade.boundsMax = high;
+        cascade.lightDirection = direction;
+        return cascade;
+    }
+
+    bool CanKeepCascade(const ShadowCascade& cached, const ShadowCascade& tight, const ShadowCascade& padded)
+    {
+        if (cached.lightDirection != tight.lightDirection || cached.nearDistance != tight.nearDistance
+            || cached.farDistance != tight.farDistance) {
+            return false;
+        }
+        // the far plane has to stay behind the receivers, the near plane may not
+        bool covers = cached.boundsMin.x <= tight.boundsMin.x && cached.boundsMax.x >= tight.boundsMax.x
+            && cached.boundsMin.y <= tight.boundsMin.y && cached.boundsMax.y >= tight.boundsMax.y
+            && cached.boundsMin.z <= tight.boundsMin.z;
+        return covers && cached.texelSize <= padded.texelSize * SHADOW_CACHE_SLACK;
+    }
+}
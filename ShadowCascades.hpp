@@ -0,0 +1,63 @@
+#ifndef ShadowCascades_hpp
+#define ShadowCascades_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+namespace gps {
+
+    struct Bounds;
+
+    // Cascaded shadow maps for the directional light: the camera frustum up to the
+    // shadow distance is cut into slices and each slice gets its own layer of a
+    // depth texture array, so the texels are spent where the viewer is.
+    static const int SHADOW_CASCADE_COUNT = 4;
+
+    // The tight bounds move in steps of 1/SHADOW_FIT_STEPS of the slice's bounding
+    // sphere diameter, so the texel size only changes when a step is crossed
+    static const int SHADOW_FIT_STEPS = 16;
+
+    // A cached cascade is refitted with this many steps of margin on every side, and
+    // kept until the receivers leave it or its texels get SHADOW_CACHE_SLACK times
+    // larger than a refit would give
+    static const int SHADOW_CACHE_MARGIN_STEPS = 2;
+    static const float SHADOW_CACHE_SLACK = 1.25f;
+
+    struct ShadowCascade
+    {
+        glm::mat4 lightSpace;
+        float nearDistance;   // view-space depth range the cascade covers
+        float farDistance;
+        float texelSize;      // world units per shadow map texel, the larger axis
+        float sphereTexelSize;   // what a fit around the whole slice would have given
+        // the fitted box in the light view, and the direction that view was built from
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        glm::vec3 lightDirection;
+    };
+
+    // Practical split scheme (Zhang et al.): lambda 1 is logarithmic, 0 is uniform.
+    // Writes SHADOW_CASCADE_COUNT + 1 distances, from nearPlane to farPlane.
+    void ComputeCascadeSplits(float nearPlane, float farPlane, float lambda, float* splits);
+
+    // Orthographic light space for the view frustum slice [nearDistance, farDistance].
+    // Across the light it covers the part of the slice where the world-space boxes
+    // (the scene's receivers) are; along the light it reaches from the farthest
+    // receiver to the highest box that can cast into that area. With no boxes in the
+    // slice it shrinks to a single step around the slice center. Bounds are snapped
+    // to whole texels in a light view that only depends on the direction, so the
+    // shadow edges do not shimmer; marginSteps grows the box on every side first.
+    // lightDirection points towards the light.
+    ShadowCascade FitCascade(const glm::mat4& inverseView, float fovy, float aspect, float nearDistance,
+        float farDistance, const glm::vec3& lightDirection, int resolution, const Bounds* boxes, size_t boxCount,
+        int marginSteps = 0);
+
+    // Whether a cached cascade can stay for this frame: it was fitted for the same light
+    // direction, covers the receivers of the tight fit and its texels are within
+    // SHADOW_CACHE_SLACK of the padded fit that would replace it. Casters nearer the light
+    // than its near plane are left to depth clamping.
+    bool CanKeepCascade(const ShadowCascade& cached, const ShadowCascade& tight, const ShadowCascade& padded);
+}
+
+#endif /* ShadowCascades_hpp */
@@ -0,0 +1,389 @@
+#include "Simplifier.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+    // Sum of squared distances to a set of planes, each weighted by its triangle area
+    struct Quadric
+    {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+        double weight;
+    };
+
+    static void AddPlane(Quadric& q, double a, double b, double c, double d, double weight)
+    {
+        q.a2 += weight * a * a; q.ab += weight * a * b; q.ac += weight * a * c; q.ad += weight * a * d;
+        q.b2 += weight * b * b; q.bc += weight * b * c; q.bd += weight * b * d;
+        q.c2 += weight * c * c; q.cd += weight * c * d;
+        q.d2 += weight * d * d;
+        q.weight += weight;
+    }
+
+    static void AddQuadric(Quadric& q, const Quadric& other)
+    {
+        q.a2 += other.a2; q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+        q.b2 += other.b2; q.bc += other.bc; q.bd += other.bd;
+        q.c2 += other.c2; q.cd += other.cd;
+        q.d2 += other.d2;
+        q.weight += other.weight;
+    }
+
+    // Mean squared distance from p to the planes of q
+    static double Evaluate(const Quadric& q, const glm::vec3& p)
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double error = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+            + q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+            + q.c2 * z * z + 2.0 * q.cd * z
+            + q.d2;
+        return q.weight > 0.0 && error > 0.0 ? error / q.weight : 0.0;
+    }
+
+    struct PositionKey
+    {
+        unsigned int bits[3];
+
+        bool operator==(const PositionKey& other) const {
+            return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+        }
+    };
+
+    struct PositionKeyHash
+    {
+        size_t operator()(const PositionKey& key) const {
+            return (size_t)key.bits[0] * 73856093u ^ (size_t)key.bits[1] * 19349663u ^ (size_t)key.bits[2] * 83492791u;
+        }
+    };
+
+    struct Collapse
+    {
+        GLuint from;
+        GLuint to;
+        double cost;
+
+        bool operator<(const Collapse& other) const {
+            return cost < other.cost;
+        }
+    };
+
+    class Simplifier
+    {
+    public:
+        Simplifier(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount)
+            : vertices(vertices), maxError(0.0)
+        {
+            // vertices split only by their attributes share one welded vertex
+            std::unordered_map<PositionKey, GLuint, PositionKeyHash> lookup;
+            welded.resize(vertexCount);
+            for (size_t v = 0; v < vertexCount; v++) {
+                PositionKey key;
+                memcpy(key.bits, &vertices[v].Position, sizeof(key.bits));
+                std::unordered_map<PositionKey, GLuint, PositionKeyHash>::iterator found = lookup.find(key);
+                if (found == lookup.end()) {
+                    found = lookup.insert(std::make_pair(key, (GLuint)positions.size())).first;
+                    positions.push_back(vertices[v].Position);
+                }
+                welded[v] = found->second;
+            }
+
+            copyStart.assign(positions.size() + 1, 0);
+            for (size_t v = 0; v < vertexCount; v++) {
+                copyStart[welded[v] + 1]++;
+            }
+            for (size_t w = 0; w < positions.size(); w++) {
+                copyStart[w + 1] += copyStart[w];
+            }
+            copies.resize(vertexCount);
+            std::vector<GLuint> fill(copyStart.begin(), copyStart.end() - 1);
+            for (size_t v = 0; v < vertexCount; v++) {
+                copies[fill[welded[v]]++] = (GLuint)v;
+            }
+
+            // triangles that are already degenerate after welding carry no surface
+            for (size_t i = 0; i + 2 < indexCount; i += 3) {
+                GLuint a = welded[indices[i]], b = welded[indices[i + 1]], c = welded[indices[i + 2]];
+                if (a == b || b == c || c == a) {
+                    continue;
+                }
+                triangles.push_back(a);
+                triangles.push_back(b);
+                triangles.push_back(c);
+                corners.push_back(indices[i]);
+                corners.push_back(indices[i + 1]);
+                corners.push_back(indices[i + 2]);
+            }
+
+            Quadric zero;
+            memset(&zero, 0, sizeof(zero));
+            quadrics.assign(positions.size(), zero);
+            for (size_t i = 0; i < triangles.size(); i += 3) {
+                const glm::vec3& p0 = positions[triangles[i]];
+                glm::vec3 normal = glm::cross(positions[triangles[i + 1]] - p0, positions[triangles[i + 2]] - p0);
+                float length = glm::length(normal);
+                if (length <= 0.0f) {
+                    continue;
+                }
+                normal /= length;
+                double d = -glm::dot(normal, p0);
+                for (int k = 0; k < 3; k++) {
+                    AddPlane(quadrics[triangles[i + k]], normal.x, normal.y, normal.z, d, length * 0.5);
+                }
+            }
+
+            LockBorders();
+        }
+
+        size_t GetTriangleCount() const
+        {
+            return triangles.size() / 3;
+        }
+
+        const std::vector<GLuint>& GetCorners() const
+        {
+            return corners;
+        }
+
+        float GetError() const
+        {
+            return (float)std::sqrt(maxError);
+        }
+
+        // Collapses up to maxCollapses independent edges, cheapest first; returns how many
+        size_t CollapsePass(size_t maxCollapses)
+        {
+            BuildAdjacency();
+
+            edgeKeys.clear();
+            for (size_t i = 0; i < triangles.size(); i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    GLuint a = triangles[i + k], b = triangles[i + (k + 1) % 3];
+                    edgeKeys.push_back(a < b ? ((unsigned long long)a << 32 | b) : ((unsigned long long)b << 32 | a));
+                }
+            }
+            std::sort(edgeKeys.begin(), edgeKeys.end());
+            edgeKeys.erase(std::unique(edgeKeys.begin(), edgeKeys.end()), edgeKeys.end());
+
+            candidates.clear();
+            for (size_t e = 0; e < edgeKeys.size(); e++) {
+                GLuint a = (GLuint)(edgeKeys[e] >> 32), b = (GLuint)(edgeKeys[e] & 0xffffffffu);
+                double costAB = locked[a] ? DBL_MAX : Cost(a, b);
+                double costBA = locked[b] ? DBL_MAX : Cost(b, a);
+                if (costAB == DBL_MAX && costBA == DBL_MAX) {
+                    continue;
+                }
+                Collapse collapse;
+                collapse.from = costAB <= costBA ? a : b;
+                collapse.to = costAB <= costBA ? b : a;
+                collapse.cost = std::min(costAB, costBA);
+                candidates.push_back(collapse);
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            touched.assign(positions.size(), 0);
+            remap.resize(positions.size());
+            for (size_t w = 0; w < remap.size(); w++) {
+                remap[w] = (GLuint)w;
+            }
+
+            size_t collapsed = 0;
+            for (size_t c = 0; c < candidates.size() && collapsed < maxCollapses; c++) {
+                const Collapse& collapse = candidates[c];
+                if (touched[collapse.from] || touched[collapse.to] || Flips(collapse.from, collapse.to)) {
+                    continue;
+                }
+                remap[collapse.from] = collapse.to;
+                AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+                maxError = std::max(maxError, collapse.cost);
+                // the neighbourhood is frozen for the rest of the pass so the flip tests stay valid
+                for (GLuint t = adjacencyStart[collapse.from]; t < adjacencyStart[collapse.from + 1]; t++) {
+                    for (int k = 0; k < 3; k++) {
+                        touched[triangles[adjacency[t] * 3 + k]] = 1;
+                    }
+                }
+                collapsed++;
+            }
+
+            if (collapsed > 0) {
+                ApplyRemap();
+            }
+            return collapsed;
+        }
+
+    private:
+        const Vertex* vertices;
+        std::vector<GLuint> welded;       // original vertex -> welded vertex
+        std::vector<glm::vec3> positions; // per welded vertex
+        std::vector<GLuint> copyStart;    // welded vertex -> its original vertices
+        std::vector<GLuint> copies;
+        std::vector<Quadric> quadrics;
+        std::vector<unsigned char> locked;
+
+        std::vector<GLuint> triangles;    // welded corners of the current triangles
+        std::vector<GLuint> corners;      // original-vertex corners of the same triangles
+        double maxError;
+
+        // per pass scratch
+        std::vector<GLuint> adjacencyStart;
+        std::vector<GLuint> adjacency;
+        std::vector<unsigned long long> edgeKeys;
+        std::vector<Collapse> candidates;
+        std::vector<unsigned char> touched;
+        std::vector<GLuint> remap;
+
+        void LockBorders()
+        {
+            // an edge used by a single triangle lies on an open border
+            std::vector<unsigned long long> directed;
+            for (size_t i = 0; i < triangles.size(); i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    GLuint a = triangles[i + k], b = triangles[i + (k + 1) % 3];
+                    directed.push_back(a < b ? ((unsigned long long)a << 32 | b) : ((unsigned long long)b << 32 | a));
+                }
+            }
+            std::sort(directed.begin(), directed.end());
+
+            locked.assign(positions.size(), 0);
+            for (size_t i = 0; i < directed.size();) {
+                size_t j = i;
+                while (j < directed.size() && directed[j] == directed[i]) {
+                    j++;
+                }
+                if (j - i == 1) {
+                    locked[directed[i] >> 32] = 1;
+                    locked[directed[i] & 0xffffffffu] = 1;
+                }
+                i = j;
+            }
+        }
+
+        void BuildAdjacency()
+        {
+            adjacencyStart.assign(positions.size() + 1, 0);
+            for (size_t i = 0; i < triangles.size(); i++) {
+                adjacencyStart[triangles[i] + 1]++;
+            }
+            for (size_t w = 0; w < positions.size(); w++) {
+                adjacencyStart[w + 1] += adjacencyStart[w];
+            }
+            adjacency.resize(triangles.size());
+            std::vector<GLuint> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t i = 0; i < triangles.size(); i++) {
+                adjacency[fill[triangles[i]]++] = (GLuint)(i / 3);
+            }
+        }
+
+        double Cost(GLuint from, GLuint to) const
+        {
+            Quadric sum = quadrics[from];
+            AddQuadric(sum, quadrics[to]);
+            return Evaluate(sum, positions[to]);
+        }
+
+        // Whether moving `from` onto `to` turns any surviving triangle by more than ~75 degrees
+        bool Flips(GLuint from, GLuint to) const
+        {
+            for (GLuint t = adjacencyStart[from]; t < adjacencyStart[from + 1]; t++) {
+                const GLuint* corner = &triangles[adjacency[t] * 3];
+                if (corner[0] == to || corner[1] == to || corner[2] == to) {
+                    continue;
+                }
+                glm::vec3 p[3], q[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = positions[corner[k]];
+                    q[k] = corner[k] == from ? positions[to] : p[k];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                float lengths = glm::length(before) * glm::length(after);
+                if (lengths <= 0.0f || glm::dot(before, after) < 0.25f * lengths) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Copy of welded vertex w whose attributes are closest to the original vertex
+        GLuint NearestCopy(GLuint w, GLuint original) const
+        {
+            const Vertex& reference = vertices[original];
+            GLuint best = copies[copyStart[w]];
+            float bestDistance = FLT_MAX;
+            for (GLuint c = copyStart[w]; c < copyStart[w + 1]; c++) {
+                const Vertex& candidate = vertices[copies[c]];
+                glm::vec3 dn = candidate.Normal - reference.Normal;
+                glm::vec2 dt = candidate.TexCoords - reference.TexCoords;
+                float distance = glm::dot(dn, dn) + glm::dot(dt, dt);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = copies[c];
+                }
+            }
+            return best;
+        }
+
+        void ApplyRemap()
+        {
+            size_t write = 0;
+            for (size_t i = 0; i < triangles.size(); i += 3) {
+                GLuint a = remap[triangles[i]], b = remap[triangles[i + 1]], c = remap[triangles[i + 2]];
+                if (a == b || b == c || c == a) {
+                    continue;
+                }
+                GLuint moved[3] = { a, b, c };
+                for (int k = 0; k < 3; k++) {
+                    GLuint corner = corners[i + k];
+                    if (moved[k] != triangles[i + k]) {
+                        corner = NearestCopy(moved[k], corner);
+                    }
+                    triangles[write + k] = moved[k];
+                    corners[write + k] = corner;
+                }
+                write += 3;
+            }
+            triangles.resize(write);
+            corners.resize(write);
+        }
+    };
+
+    void SimplifyMesh(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+        const float* targetRatios, size_t levelCount, std::vector<SimplifiedLevel>& levels)
+    {
+        levels.clear();
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        Simplifier simplifier(vertices, vertexCount, indices, indexCount);
+        size_t previousCount = triangleCount;
+        for (size_t level = 0; level < levelCount; level++) {
+            size_t target = (size_t)(triangleCount * targetRatios[level]);
+            bool stuck = false;
+            while (simplifier.GetTriangleCount() > target) {
+                // each collapse removes about two triangles
+                if (simplifier.CollapsePass((simplifier.GetTriangleCount() - target) / 2 + 1) == 0) {
+                    stuck = true;
+                    break;
+                }
+            }
+
+            // a level that hardly shrank is not worth a draw range of its own
+            if (simplifier.GetTriangleCount() < previousCount * 85 / 100) {
+                SimplifiedLevel simplified;
+                simplified.indices = simplifier.GetCorners();
+                simplified.error = simplifier.GetError();
+                levels.push_back(simplified);
+                previousCount = simplifier.GetTriangleCount();
+            }
+            if (stuck) {
+                break;
+            }
+        }
+    }
+}
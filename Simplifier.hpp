@@ -0,0 +1,31 @@
+#ifndef Simplifier_hpp
+#define Simplifier_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    struct Vertex;
+
+    // One reduced index list over the vertices of the source mesh
+    struct SimplifiedLevel
+    {
+        std::vector<GLuint> indices;
+        // RMS distance from the moved vertices to the planes they left, in mesh units
+        float error;
+    };
+
+    // Quadric error metric simplification by edge collapse onto existing vertices, so
+    // every level indexes the original vertex array and needs no new vertices.
+    // Vertices sharing a position are collapsed together; corners pick the copy whose
+    // normal and texture coordinates are closest to what they had. Open borders stay
+    // in place. Produces one level per entry of targetRatios (fractions of the input
+    // triangle count, decreasing), stopping early when the mesh cannot get smaller.
+    void SimplifyMesh(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+        const float* targetRatios, size_t levelCount, std::vector<SimplifiedLevel>& levels);
+}
+
+#endif /* Simplifier_hpp */
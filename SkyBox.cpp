@@ -1,4 +1,8 @@
 #include "SkyBox.hpp"
+#include "GLStateCache.hpp"
+
+#include <map>
+#include <string>
 
 namespace gps {
     
@@ -13,59 +17,62 @@ namespace gps {
         InitSkyBox();
     }
     
-    void SkyBox::Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix, float fogDensity)
+    void SkyBox::Draw(const gps::Shader& shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix, float fogDensity)
     {
         shader.useShaderProgram();
         
         //set the view and projection matrices
         glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        shader.setMat4("view", transformedView);
+        shader.setMat4("projection", projectionMatrix);
 
-		glUniform1f(glGetUniformLocation(shader.shaderProgram, "fogDensity"), (GLfloat)fogDensity);
+		shader.setFloat("fogDensity", (GLfloat)fogDensity);
 
         
-        glDepthFunc(GL_LEQUAL);
+        GLStateCache& state = GLStateCache::GetInstance();
+        state.DepthFunc(GL_LEQUAL);
         
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        state.BindVertexArray(skyboxVAO);
+        shader.setInt("skybox", 0);
+        state.BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
         
-        glDepthFunc(GL_LESS);
+        state.DepthFunc(GL_LESS);
     }
     
     GLuint SkyBox::LoadSkyBoxTextures(std::vector<const GLchar*> skyBoxFaces)
     {
         GLuint textureID;
         glGenTextures(1, &textureID);
-        glActiveTexture(GL_TEXTURE0);
         
-        int width,height, n;
-        unsigned char* image;
         int force_channels = 3;
         
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-        for(GLuint i = 0; i < skyBoxFaces.size(); i++)
-        {
-            image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
-            if (!image) {
-                fprintf(stderr, "ERROR: could not load %s\n", skyBoxFaces[i]);
-                return false;
-            }
-            glTexImage2D(
-                         GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
-                         GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image
-                         );
-        }
+        GLStateCache::GetInstance().BindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        
+        // faces decode in parallel and are uploaded by the TextureUploader, grey until then
+        std::map<std::string, std::shared_future<DecodedImagePtr> > decodes;
+        for(GLuint i = 0; i < skyBoxFaces.size(); i++)
+        {
+            std::string face = skyBoxFaces[i];
+            if (decodes.find(face) == decodes.end()) {
+                decodes[face] = DecodeImageAsync(GetPreferredImagePath(face), force_channels, false);
+            }
+            
+            UploadTarget target;
+            target.texture = textureID;
+            target.bindTarget = GL_TEXTURE_CUBE_MAP;
+            target.imageTarget = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+            target.internalFormat = GL_RGB;
+            target.format = GL_RGB;
+            target.generateMipmaps = false;
+            TextureUploader::SetPlaceholder(textureID, target.bindTarget, target.imageTarget, target.internalFormat);
+            TextureUploader::GetInstance().Add(decodes[face], target);
+        }
         
         return textureID;
     }
@@ -119,14 +126,14 @@ namespace gps {
         glGenVertexArrays(1, &(this->skyboxVAO));
         glGenBuffers(1, &skyboxVBO);
         
-        glBindVertexArray(skyboxVAO);
+        GLStateCache::GetInstance().BindVertexArray(skyboxVAO);
         glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
         
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
         
-        glBindVertexArray(0);
+        GLStateCache::GetInstance().BindVertexArray(0);
     }
     
     GLuint SkyBox::GetTextureId()
@@ -4,7 +4,7 @@
 #include <stdio.h>
 #include "Shader.hpp"
 #include <vector>
-#include "stb_image.h"
+#include "TextureLoader.hpp"
 #include "glm/glm.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
@@ -14,7 +14,7 @@ namespace gps {
     public:
         SkyBox();
         void Load(std::vector<const GLchar*> cubeMapFaces);
-        void Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix, float fogDensity);
+        void Draw(const gps::Shader& shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix, float fogDensity);
         GLuint GetTextureId();
     private:
         GLuint skyboxVAO;
@@ -0,0 +1,151 @@
+#include "TextureCache.hpp"
+
+#include "GLStateCache.hpp"
+#include "TextureLoader.hpp"
+
+#include <iostream>
+#include <vector>
+
+namespace gps {
+
+    TextureCache::TextureCache()
+    {
+    }
+
+    TextureCache& TextureCache::GetInstance()
+    {
+        static TextureCache instance;
+        return instance;
+    }
+
+    GLuint TextureCache::Acquire(const std::string& path)
+    {
+        std::string key = CanonicalPath(path);
+
+        std::unordered_map<std::string, GLuint>::iterator found = idsByPath.find(key);
+        if (found != idsByPath.end()) {
+            Entry& shared = entries[found->second];
+            shared.refCount++;
+            shared.acquireCount++;
+            return found->second;
+        }
+
+        Entry entry;
+        entry.path = key;
+        entry.refCount = 1;
+        entry.acquireCount = 1;
+        entry.bytes = 0;
+        entry.decodeMilliseconds = 0.0;
+
+        // the id is handed out right away, the pixels arrive once the decode finishes
+        GLuint id;
+        glGenTextures(1, &id);
+        GLStateCache::GetInstance().BindTexture(0, GL_TEXTURE_2D, id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        TextureUploader::SetPlaceholder(id, GL_TEXTURE_2D, GL_TEXTURE_2D, GL_SRGB);
+
+        entries[id] = entry;
+        idsByPath[key] = id;
+
+        UploadTarget target;
+        target.texture = id;
+        target.bindTarget = GL_TEXTURE_2D;
+        target.imageTarget = GL_TEXTURE_2D;
+        target.internalFormat = GL_SRGB;
+        target.format = GL_RGBA;
+        target.generateMipmaps = true;
+
+        // a converted .dds brings its own compressed mip chain
+        std::shared_future<DecodedImagePtr> decode = DecodeImageAsync(GetPreferredImagePath(key), 4, true, SRGB_MIP_CHAIN);
+        TextureUploader::GetInstance().Add(decode, target, [this, id](const DecodedImage& image) {
+            std::unordered_map<GLuint, Entry>::iterator uploaded = entries.find(id);
+            if (uploaded == entries.end()) {
+                return;
+            }
+            if (image.pixels.empty()) {
+                // not cached, so a later Acquire of the path loads it again
+                std::unordered_map<std::string, GLuint>::iterator path = idsByPath.find(uploaded->second.path);
+                if (path != idsByPath.end() && path->second == id) {
+                    idsByPath.erase(path);
+                }
+                return;
+            }
+            uploaded->second.bytes = GetUploadedBytes(image, true);
+            uploaded->second.decodeMilliseconds = image.decodeMilliseconds;
+        });
+
+        return id;
+    }
+
+    void TextureCache::Release(GLuint textureId)
+    {
+        std::unordered_map<GLuint, Entry>::iterator entry = entries.find(textureId);
+        if (entry == entries.end() || --entry->second.refCount > 0) {
+            return;
+        }
+
+        glDeleteTextures(1, &textureId);
+        // the name may come back from glGenTextures while still shadowed as bound
+        GLStateCache::GetInstance().Invalidate();
+        std::unordered_map<std::string, GLuint>::iterator path = idsByPath.find(entry->second.path);
+        if (path != idsByPath.end() && path->second == textureId) {
+            idsByPath.erase(path);
+        }
+        entries.erase(entry);
+    }
+
+    void TextureCache::PrintStatistics() const
+    {
+        size_t residentBytes = 0, bytesSaved = 0, sharedUses = 0;
+        double decodeMillisecondsSaved = 0.0;
+        for (std::unordered_map<GLuint, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+            const Entry& entry = it->second;
+            residentBytes += entry.bytes;
+            sharedUses += entry.acquireCount - 1;
+            bytesSaved += (entry.acquireCount - 1) * entry.bytes;
+            decodeMillisecondsSaved += (entry.acquireCount - 1) * entry.decodeMilliseconds;
+        }
+
+        std::cout << "# of textures  : " << entries.size() << " unique, " << sharedUses << " shared uses" << std::endl;
+        std::cout << "Texture VRAM   : " << residentBytes / (1024 * 1024) << " MB resident, "
+            << bytesSaved / (1024 * 1024) << " MB saved by sharing" << std::endl;
+        std::cout << "Decode time    : " << (int)decodeMillisecondsSaved << " ms saved by sharing" << std::endl;
+    }
+
+    std::string TextureCache::CanonicalPath(const std::string& path)
+    {
+        std::vector<std::string> parts;
+        bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+
+        size_t start = 0;
+        while (start <= path.size()) {
+            size_t end = path.find_first_of("/\\", start);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+            std::string part = path.substr(start, end - start);
+            if (part == "..") {
+                if (!parts.empty() && parts.back() != "..") {
+                    parts.pop_back();
+                } else if (!absolute) {
+                    parts.push_back(part);
+                }
+            } else if (!part.empty() && part != ".") {
+                parts.push_back(part);
+            }
+            start = end + 1;
+        }
+
+        std::string canonical = absolute ? "/" : "";
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (i > 0) {
+                canonical += '/';
+            }
+            canonical += parts[i];
+        }
+        return canonical;
+    }
+}
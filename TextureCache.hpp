@@ -0,0 +1,51 @@
+#ifndef TextureCache_hpp
+#define TextureCache_hpp
+
+#include <GL/glew.h>
+
+#include <string>
+#include <unordered_map>
+
+namespace gps {
+
+    // Process-wide, reference-counted registry of 2D textures keyed by canonical
+    // path. Every image is decoded and uploaded once no matter how many models use it.
+    class TextureCache
+    {
+    public:
+        static TextureCache& GetInstance();
+
+        // Returns the texture for path. On first use the image is decoded in the
+        // background and uploaded by the next TextureUploader::Flush(). A path that
+        // failed to load is forgotten once the uploader reports it, so the next
+        // Acquire tries again under a new id; the old one keeps the grey placeholder.
+        GLuint Acquire(const std::string& path);
+
+        // Drops one reference; the texture is deleted with the last one
+        void Release(GLuint textureId);
+
+        // Prints the decode time and video memory saved by sharing (after the uploads)
+        void PrintStatistics() const;
+
+        // Lexically normalized path ("a/./b/../c" -> "a/c", '\\' -> '/')
+        static std::string CanonicalPath(const std::string& path);
+
+    private:
+        struct Entry
+        {
+            std::string path;
+            int refCount;
+            size_t acquireCount;
+            size_t bytes;
+            double decodeMilliseconds;
+        };
+
+        std::unordered_map<GLuint, Entry> entries;
+        // paths whose texture loaded or is still loading
+        std::unordered_map<std::string, GLuint> idsByPath;
+
+        TextureCache();
+    };
+}
+
+#endif /* TextureCache_hpp */
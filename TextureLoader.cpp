@@ -0,0 +1,528 @@
+#include "TextureLoader.hpp"
+#include "Dds.hpp"
+#include "GLStateCache.hpp"
+#include "ImageOps.hpp"
+#include "ThreadPool.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace gps {
+
+    // Pixel buffers in the streaming ring; a buffer is reused once its fence signals
+    static const size_t PIXEL_BUFFER_COUNT = 3;
+    static const size_t PIXEL_BUFFER_SIZE = 4 * 1024 * 1024;
+
+    static bool IsDdsPath(const std::string& path)
+    {
+        return path.size() > 4 && path.compare(path.size() - 4, 4, ".dds") == 0;
+    }
+
+    static void ReadCompressedImage(const std::string& path, bool flipVertically, DecodedImage& image)
+    {
+        DdsImage dds;
+        if (!ReadDds(path, dds)) {
+            fprintf(stderr, "ERROR: could not load %s\n", path.c_str());
+            return;
+        }
+        // a file converted for the other orientation is turned around here
+        if (dds.bottomUp != flipVertically) {
+            int width = dds.width, height = dds.height;
+            for (size_t i = 0; i < dds.levels.size(); i++) {
+                FlipCompressedImage(dds.levels[i], width, height, dds.format);
+                width = std::max(1, width / 2);
+                height = std::max(1, height / 2);
+            }
+        }
+
+        image.compressedFormat = dds.format == BLOCK_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        image.width = dds.width;
+        image.height = dds.height;
+        image.pixels.swap(dds.levels[0]);
+        int width = dds.width, height = dds.height;
+        for (size_t i = 1; i < dds.levels.size(); i++) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            image.mipmaps.push_back(MipLevel());
+            image.mipmaps.back().width = width;
+            image.mipmaps.back().height = height;
+            image.mipmaps.back().pixels.swap(dds.levels[i]);
+        }
+    }
+
+    static DecodedImagePtr DecodeImage(const std::string& path, int channels, bool flipVertically, MipChain mipChain)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        DecodedImagePtr image = std::make_shared<DecodedImage>();
+        image->path = path;
+        image->width = 0;
+        image->height = 0;
+        image->channels = channels;
+        image->compressedFormat = 0;
+
+        if (IsDdsPath(path)) {
+            ReadCompressedImage(path, flipVertically, *image);
+            image->decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return image;
+        }
+
+        // RGB files requested as RGBA are expanded here rather than by stb's scalar conversion
+        int x, y, n;
+        if (!stbi_info(path.c_str(), &x, &y, &n)) {
+            n = channels;
+        }
+        bool expand = n == 3 && channels == 4;
+        unsigned char* image_data = stbi_load(path.c_str(), &x, &y, &n, expand ? 3 : channels);
+        if (!image_data) {
+            fprintf(stderr, "ERROR: could not load %s\n", path.c_str());
+            image->decodeMilliseconds = 0.0;
+            return image;
+        }
+        // NPOT check
+        if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+            fprintf(stderr, "WARNING: texture %s is not power-of-2 dimensions\n", path.c_str());
+        }
+
+        image->width = x;
+        image->height = y;
+        image->pixels.resize((size_t)x * y * channels);
+        if (expand) {
+            ImageOps::ExpandRGBToRGBA(image_data, &image->pixels[0], (size_t)x * y);
+        } else {
+            memcpy(&image->pixels[0], image_data, image->pixels.size());
+        }
+        stbi_image_free(image_data);
+
+        if (flipVertically) {
+            ImageOps::FlipRows(&image->pixels[0], x, y, channels);
+        }
+
+        if (mipChain != NO_MIP_CHAIN) {
+            const unsigned char* source = &image->pixels[0];
+            int width = x, height = y;
+            while (width > 1 || height > 1) {
+                image->mipmaps.push_back(MipLevel());
+                MipLevel& level = image->mipmaps.back();
+                level.width = std::max(1, width / 2);
+                level.height = std::max(1, height / 2);
+                level.pixels.resize((size_t)level.width * level.height * channels);
+                ImageOps::Downsample(source, width, height, channels, mipChain == SRGB_MIP_CHAIN, &level.pixels[0]);
+                source = &level.pixels[0];
+                width = level.width;
+                height = level.height;
+            }
+        }
+
+        image->decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return image;
+    }
+
+#ifdef GPS_BENCHMARK_TEXTURE_DECODE
+    struct DecodeRequest
+    {
+        std::string path;
+        int channels;
+        bool flipVertically;
+        MipChain mipChain;
+        // the shared pool's decode, finished before the benchmark starts
+        std::shared_future<DecodedImagePtr> decode;
+    };
+
+    // every decode of the run, replayed by RunDecodeBenchmark
+    static std::vector<DecodeRequest> decodeRequests;
+#endif
+
+    std::shared_future<DecodedImagePtr> DecodeImageAsync(const std::string& path, int channels, bool flipVertically,
+        MipChain mipChain)
+    {
+        std::shared_future<DecodedImagePtr> decode = ThreadPool::GetShared().Submit([path, channels, flipVertically, mipChain]() {
+            return DecodeImage(path, channels, flipVertically, mipChain);
+        }).share();
+#ifdef GPS_BENCHMARK_TEXTURE_DECODE
+        DecodeRequest request = { path, channels, flipVertically, mipChain, decode };
+        decodeRequests.push_back(request);
+#endif
+        return decode;
+    }
+
+#ifdef GPS_BENCHMARK_TEXTURE_DECODE
+    void RunDecodeBenchmark()
+    {
+        if (decodeRequests.empty()) {
+            return;
+        }
+        // with streaming the shared pool is still decoding, and would compete with the pools below
+        for (size_t i = 0; i < decodeRequests.size(); i++) {
+            decodeRequests[i].decode.wait();
+            decodeRequests[i].decode = std::shared_future<DecodedImagePtr>();
+        }
+        unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        std::cout << "Decode scaling : " << decodeRequests.size() << " images" << std::endl;
+        double singleThread = 0.0;
+        for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+            ThreadPool pool(threads);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::vector<std::future<DecodedImagePtr> > decodes;
+            for (size_t i = 0; i < decodeRequests.size(); i++) {
+                const DecodeRequest& request = decodeRequests[i];
+                decodes.push_back(pool.Submit([request]() {
+                    return DecodeImage(request.path, request.channels, request.flipVertically, request.mipChain);
+                }));
+            }
+            for (size_t i = 0; i < decodes.size(); i++) {
+                decodes[i].wait();
+            }
+            double wallMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (threads == 1) {
+                singleThread = wallMilliseconds;
+            }
+            std::cout << "  " << threads << (threads == 1 ? " thread : " : " threads: ") << (int)wallMilliseconds
+                << " ms, " << singleThread / wallMilliseconds << "x" << std::endl;
+        }
+    }
+#endif
+
+    std::string GetPreferredImagePath(const std::string& path)
+    {
+        // the model textures are uploaded in the sRGB variants of the S3TC formats
+        if (!GLEW_EXT_texture_compression_s3tc || !GLEW_EXT_texture_sRGB) {
+            return path;
+        }
+        std::string ddsPath = FindDdsVariant(path);
+        return ddsPath.empty() ? path : ddsPath;
+    }
+
+    size_t GetUploadedBytes(const DecodedImage& image, bool generateMipmaps)
+    {
+        size_t bytes = image.compressedFormat ? image.pixels.size() : (size_t)image.width * image.height * 4;
+        if (image.mipmaps.empty()) {
+            // level 0 plus roughly a third for a generated mip chain
+            return generateMipmaps ? bytes * 4 / 3 : bytes;
+        }
+        for (size_t i = 0; i < image.mipmaps.size(); i++) {
+            const MipLevel& level = image.mipmaps[i];
+            bytes += image.compressedFormat ? level.pixels.size() : (size_t)level.width * level.height * 4;
+        }
+        return bytes;
+    }
+
+    // Compressed data goes into the sRGB variant of its format when the target is sRGB
+    static GLenum GetCompressedInternalFormat(const DecodedImage& image, const UploadTarget& target)
+    {
+        bool srgb = target.internalFormat == GL_SRGB || target.internalFormat == GL_SRGB8 ||
+            target.internalFormat == GL_SRGB_ALPHA || target.internalFormat == GL_SRGB8_ALPHA8;
+        if (!srgb) {
+            return image.compressedFormat;
+        }
+        return image.compressedFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ?
+            GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+    }
+
+    static void UploadLevel(const DecodedImage& image, const UploadTarget& target, GLint level, int width, int height,
+        const std::vector<unsigned char>& pixels)
+    {
+        if (image.compressedFormat) {
+            glCompressedTexImage2D(target.imageTarget, level, GetCompressedInternalFormat(image, target), width, height, 0,
+                (GLsizei)pixels.size(), pixels.empty() ? NULL : &pixels[0]);
+        } else {
+            glTexImage2D(target.imageTarget, level, target.internalFormat, width, height, 0,
+                target.format, GL_UNSIGNED_BYTE, pixels.empty() ? NULL : &pixels[0]);
+        }
+    }
+
+    TextureUploader::TextureUploader() : streaming(false), bytesPerFrame(0), nextPixelBuffer(0),
+        streamedImages(0), streamedBytes(0), streamedFrames(0), slowestFrameMilliseconds(0.0)
+    {
+    }
+
+    TextureUploader& TextureUploader::GetInstance()
+    {
+        static TextureUploader instance;
+        return instance;
+    }
+
+    void TextureUploader::SetStreaming(bool enabled, size_t bytesPerFrame)
+    {
+        this->streaming = enabled;
+        this->bytesPerFrame = bytesPerFrame;
+    }
+
+    bool TextureUploader::IsStreaming() const
+    {
+        return streaming;
+    }
+
+    void TextureUploader::Add(std::shared_future<DecodedImagePtr> image, const UploadTarget& target,
+        std::function<void(const DecodedImage&)> onUploaded)
+    {
+        PendingUpload upload;
+        upload.image = image;
+        upload.target = target;
+        upload.onUploaded = onUploaded;
+        pending.push_back(upload);
+    }
+
+    size_t TextureUploader::GetPendingCount() const
+    {
+        return pending.size() + streamingUploads.size();
+    }
+
+    void TextureUploader::SetPlaceholder(GLuint texture, GLenum bindTarget, GLenum imageTarget, GLenum internalFormat)
+    {
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+        GLStateCache::GetInstance().BindTexture(0, bindTarget, texture);
+        glTexImage2D(imageTarget, 0, internalFormat, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    }
+
+    void TextureUploader::Flush()
+    {
+        if (pending.empty()) {
+            return;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t imageCount = pending.size();
+        size_t decodedBytes = 0;
+        double decodeMilliseconds = 0.0;
+
+        while (!pending.empty()) {
+            // upload whatever is ready, otherwise wait a little for the next decode
+            bool uploaded = false;
+            for (size_t i = 0; i < pending.size(); ) {
+                if (pending[i].image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    i++;
+                    continue;
+                }
+                const DecodedImage& image = *pending[i].image.get();
+                decodedBytes += image.pixels.size();
+                decodeMilliseconds += image.decodeMilliseconds;
+                Upload(pending[i]);
+                pending.erase(pending.begin() + i);
+                uploaded = true;
+            }
+            if (!uploaded) {
+                pending.front().image.wait_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        // wall time vs. summed decode time shows how well the decodes scale with the cores
+        double wallMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Texture upload : " << imageCount << " images, " << decodedBytes / (1024 * 1024) << " MB decoded, "
+            << (int)decodeMilliseconds << " ms of decode work finished in " << (int)wallMilliseconds << " ms on "
+            << ThreadPool::GetShared().GetThreadCount() << " threads" << std::endl;
+    }
+
+    void TextureUploader::Upload(const PendingUpload& upload)
+    {
+        const DecodedImage& image = *upload.image.get();
+        if (image.pixels.empty()) {
+            if (upload.onUploaded) {
+                upload.onUploaded(image);
+            }
+            return;
+        }
+
+        const UploadTarget& target = upload.target;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        GLStateCache::GetInstance().BindTexture(0, target.bindTarget, target.texture);
+        UploadLevel(image, target, 0, image.width, image.height, image.pixels);
+        for (size_t i = 0; i < image.mipmaps.size(); i++) {
+            const MipLevel& level = image.mipmaps[i];
+            UploadLevel(image, target, (GLint)i + 1, level.width, level.height, level.pixels);
+        }
+        if (image.mipmaps.empty() && target.generateMipmaps && !image.compressedFormat) {
+            glGenerateMipmap(target.bindTarget);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        if (upload.onUploaded) {
+            upload.onUploaded(image);
+        }
+    }
+
+    bool TextureUploader::Update()
+    {
+        if (!streaming || (pending.empty() && streamingUploads.empty())) {
+            return false;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        // decodes join the stream in the order they complete
+        for (size_t i = 0; i < pending.size(); ) {
+            if (pending[i].image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                i++;
+                continue;
+            }
+            StreamingUpload upload;
+            upload.upload = pending[i];
+            upload.image = pending[i].image.get();
+            upload.level = (int)upload.image->mipmaps.size();
+            upload.row = 0;
+            upload.allocated = false;
+            streamingUploads.push_back(upload);
+            pending.erase(pending.begin() + i);
+        }
+
+        if (pixelBuffers.empty()) {
+            for (size_t i = 0; i < PIXEL_BUFFER_COUNT; i++) {
+                PixelBuffer pixelBuffer;
+                glGenBuffers(1, &pixelBuffer.buffer);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer.buffer);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, PIXEL_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+                pixelBuffer.size = PIXEL_BUFFER_SIZE;
+                pixelBuffer.fence = 0;
+                pixelBuffers.push_back(pixelBuffer);
+            }
+        }
+
+        size_t budget = bytesPerFrame;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        while (!streamingUploads.empty() && budget > 0) {
+            StreamingUpload& current = streamingUploads.front();
+            if (!StreamSlice(current, budget)) {
+                break; // the GPU still reads every buffer of the ring
+            }
+            if (current.level < 0) {
+                if (current.upload.onUploaded) {
+                    current.upload.onUploaded(*current.image);
+                }
+                streamedImages++;
+                streamingUploads.pop_front();
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        streamedFrames++;
+        slowestFrameMilliseconds = std::max(slowestFrameMilliseconds,
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+        if (!pending.empty() || !streamingUploads.empty()) {
+            return false;
+        }
+
+        std::cout << "Texture stream : " << streamedImages << " images, " << streamedBytes / (1024 * 1024) << " MB over "
+            << streamedFrames << " frames, slowest frame spent " << slowestFrameMilliseconds << " ms uploading" << std::endl;
+        return true;
+    }
+
+    bool TextureUploader::StreamSlice(StreamingUpload& current, size_t& budget)
+    {
+        const DecodedImage& image = *current.image;
+        const UploadTarget& target = current.upload.target;
+        if (image.pixels.empty()) {
+            current.level = -1;
+            return true;
+        }
+
+        int levelCount = (int)image.mipmaps.size() + 1;
+        if (!current.allocated) {
+            // replace the placeholder with storage for every level, sampling only the smallest;
+            // with a ring buffer still bound the NULL data would be read from it
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            GLStateCache::GetInstance().BindTexture(0, target.bindTarget, target.texture);
+            for (int level = 0; level < levelCount; level++) {
+                const MipLevel* mip = level == 0 ? NULL : &image.mipmaps[level - 1];
+                int width = mip ? mip->width : image.width;
+                int height = mip ? mip->height : image.height;
+                if (image.compressedFormat) {
+                    GLsizei size = (GLsizei)(mip ? mip->pixels.size() : image.pixels.size());
+                    glCompressedTexImage2D(target.imageTarget, level, GetCompressedInternalFormat(image, target),
+                        width, height, 0, size, NULL);
+                } else {
+                    glTexImage2D(target.imageTarget, level, target.internalFormat, width, height, 0,
+                        target.format, GL_UNSIGNED_BYTE, NULL);
+                }
+            }
+            if (target.bindTarget == GL_TEXTURE_2D) {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levelCount - 1);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+            }
+            current.allocated = true;
+        }
+
+        int width = current.level == 0 ? image.width : image.mipmaps[current.level - 1].width;
+        int height = current.level == 0 ? image.height : image.mipmaps[current.level - 1].height;
+        const unsigned char* pixels = current.level == 0 ? &image.pixels[0] : &image.mipmaps[current.level - 1].pixels[0];
+
+        // compressed levels are copied in rows of 4x4 blocks
+        int rowHeight = image.compressedFormat ? 4 : 1;
+        int rowCount = (height + rowHeight - 1) / rowHeight;
+        size_t rowBytes = image.compressedFormat ?
+            GetCompressedSize(image.compressedFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? BLOCK_BC1 : BLOCK_BC3, width, 1) :
+            (size_t)width * image.channels;
+
+        PixelBuffer& pixelBuffer = pixelBuffers[nextPixelBuffer];
+        if (pixelBuffer.fence) {
+            if (glClientWaitSync(pixelBuffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                return false;
+            }
+            glDeleteSync(pixelBuffer.fence);
+            pixelBuffer.fence = 0;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer.buffer);
+        if (pixelBuffer.size < rowBytes) {
+            pixelBuffer.size = rowBytes;
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, pixelBuffer.size, NULL, GL_STREAM_DRAW);
+        }
+
+        int rows = (int)std::max((size_t)1, std::min(budget, pixelBuffer.size) / rowBytes);
+        rows = std::min(rows, rowCount - current.row);
+        size_t bytes = rowBytes * rows;
+
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!mapped) {
+            return false;
+        }
+        memcpy(mapped, pixels + rowBytes * current.row, bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        GLStateCache::GetInstance().BindTexture(0, target.bindTarget, target.texture);
+        int y = current.row * rowHeight;
+        int sliceHeight = std::min(rows * rowHeight, height - y);
+        if (image.compressedFormat) {
+            glCompressedTexSubImage2D(target.imageTarget, current.level, 0, y, width, sliceHeight,
+                GetCompressedInternalFormat(image, target), (GLsizei)bytes, (const GLvoid*)0);
+        } else {
+            glTexSubImage2D(target.imageTarget, current.level, 0, y, width, sliceHeight,
+                target.format, GL_UNSIGNED_BYTE, (const GLvoid*)0);
+        }
+        pixelBuffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        nextPixelBuffer = (nextPixelBuffer + 1) % pixelBuffers.size();
+
+        budget -= std::min(budget, bytes);
+        streamedBytes += bytes;
+
+        current.row += rows;
+        if (current.row == rowCount) {
+            // the finished level becomes the sharpest one the sampler may use
+            if (target.bindTarget == GL_TEXTURE_2D) {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, current.level);
+            }
+            current.level--;
+            current.row = 0;
+
+            if (current.level < 0) {
+                bool generateMipmaps = levelCount == 1 && target.generateMipmaps && !image.compressedFormat;
+                if (target.bindTarget == GL_TEXTURE_2D) {
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, generateMipmaps ? 1000 : levelCount - 1);
+                }
+                if (generateMipmaps) {
+                    glGenerateMipmap(target.bindTarget);
+                }
+            }
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,155 @@
+#ifndef TextureLoader_hpp
+#define TextureLoader_hpp
+
+#include <GL/glew.h>
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // One reduced level of a mip chain
+    struct MipLevel
+    {
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+
+    // Pixels decoded by a worker thread, waiting to be uploaded
+    struct DecodedImage
+    {
+        std::string path;
+        int width;
+        int height;
+        int channels;
+        // 0 for plain pixels, otherwise the (linear) S3TC format of every level
+        GLenum compressedFormat;
+        std::vector<unsigned char> pixels;
+        // levels 1..n, only present when requested
+        std::vector<MipLevel> mipmaps;
+        double decodeMilliseconds;
+    };
+
+    typedef std::shared_ptr<DecodedImage> DecodedImagePtr;
+
+    // Whether the decode worker also builds the mip chain, and in which space it filters
+    enum MipChain
+    {
+        NO_MIP_CHAIN,
+        LINEAR_MIP_CHAIN,
+        SRGB_MIP_CHAIN
+    };
+
+    // Decodes (and optionally flips) an image file on the shared thread pool and
+    // optionally box-filters the whole mip chain there as well.
+    // A .dds file is read with its own mip chain, and flipped only if it was converted
+    // for the other orientation.
+    // The result has no pixels if the file could not be read.
+    std::shared_future<DecodedImagePtr> DecodeImageAsync(const std::string& path, int channels, bool flipVertically,
+        MipChain mipChain = NO_MIP_CHAIN);
+
+#ifdef GPS_BENCHMARK_TEXTURE_DECODE
+    // Decodes every image requested so far again on pools of 1..hardware threads
+    // and prints the wall time of each, to show how the decodes scale with the cores
+    void RunDecodeBenchmark();
+#endif
+
+    // The path to decode for an image: its converted .dds when there is a current
+    // one and the driver can sample S3TC in sRGB, otherwise the image itself
+    std::string GetPreferredImagePath(const std::string& path);
+
+    // Video memory taken by the image once uploaded, including its mip chain
+    size_t GetUploadedBytes(const DecodedImage& image, bool generateMipmaps);
+
+    // Where a decoded image ends up in video memory
+    struct UploadTarget
+    {
+        GLuint texture;
+        GLenum bindTarget;     // GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+        GLenum imageTarget;    // GL_TEXTURE_2D or one cube map face
+        GLenum internalFormat;
+        GLenum format;
+        bool generateMipmaps;  // only used when the image carries no mip chain
+    };
+
+    // Decodes run in parallel while the GL thread only performs the uploads,
+    // in the order the decodes complete.
+    // In streaming mode the textures keep their placeholder texel until Update()
+    // has copied them through a ring of pixel buffer objects, at most a fixed
+    // number of bytes per frame. Mip levels go smallest first and
+    // GL_TEXTURE_BASE_LEVEL follows them, so a texture sharpens as it arrives.
+    class TextureUploader
+    {
+    public:
+        static TextureUploader& GetInstance();
+
+        void SetStreaming(bool enabled, size_t bytesPerFrame);
+        bool IsStreaming() const;
+
+        // onUploaded runs once the image is in the texture, or with an image without
+        // pixels when the decode failed
+        void Add(std::shared_future<DecodedImagePtr> image, const UploadTarget& target,
+            std::function<void(const DecodedImage&)> onUploaded = std::function<void(const DecodedImage&)>());
+
+        // Uploads every pending image, blocking until all decodes are done
+        void Flush();
+
+        // Streams up to the per-frame budget; returns true on the frame the last upload completes
+        bool Update();
+
+        size_t GetPendingCount() const;
+
+        // Fills a texture image with a single mid-grey texel until the real data arrives
+        static void SetPlaceholder(GLuint texture, GLenum bindTarget, GLenum imageTarget, GLenum internalFormat);
+
+    private:
+        struct PendingUpload
+        {
+            std::shared_future<DecodedImagePtr> image;
+            UploadTarget target;
+            std::function<void(const DecodedImage&)> onUploaded;
+        };
+
+        struct StreamingUpload
+        {
+            PendingUpload upload;
+            DecodedImagePtr image;
+            int level; // level being uploaded, counts down to 0
+            int row;   // first row (of blocks, if compressed) of the level that is not uploaded yet
+            bool allocated;
+        };
+
+        struct PixelBuffer
+        {
+            GLuint buffer;
+            size_t size;
+            GLsync fence;
+        };
+
+        std::vector<PendingUpload> pending;
+        std::deque<StreamingUpload> streamingUploads;
+
+        bool streaming;
+        size_t bytesPerFrame;
+        std::vector<PixelBuffer> pixelBuffers;
+        size_t nextPixelBuffer;
+
+        // streaming statistics
+        size_t streamedImages;
+        size_t streamedBytes;
+        size_t streamedFrames;
+        double slowestFrameMilliseconds;
+
+        TextureUploader();
+
+        void Upload(const PendingUpload& upload);
+        bool StreamSlice(StreamingUpload& current, size_t& budget);
+    };
+}
+
+#endif /* TextureLoader_hpp */
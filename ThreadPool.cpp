@@ -0,0 +1,62 @@
+#include "ThreadPool.hpp"
+
+namespace gps {
+
+    ThreadPool::ThreadPool(unsigned int threadCount) : stopping(false)
+    {
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+
+        for (unsigned int i = 0; i < threadCount; i++) {
+            workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    unsigned int ThreadPool::GetThreadCount() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    ThreadPool& ThreadPool::GetShared()
+    {
+        static ThreadPool sharedPool;
+        return sharedPool;
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!stopping && tasks.empty()) {
+                    available.wait(lock);
+                }
+                // drain the queue before stopping so no future is left unresolved
+                if (tasks.empty()) {
+                    return;
+                }
+                task = tasks.front();
+                tasks.pop();
+            }
+            task();
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace gps {
+
+    // Fixed set of worker threads consuming a FIFO of tasks
+    class ThreadPool
+    {
+    public:
+        // threadCount = 0 uses one worker per hardware thread
+        explicit ThreadPool(unsigned int threadCount = 0);
+        ~ThreadPool();
+
+        // Queues a task and returns a future for its result
+        template <typename Task>
+        std::future<decltype(std::declval<Task&>()())> Submit(Task task);
+
+        unsigned int GetThreadCount() const;
+
+        // Pool shared by the loaders
+        static ThreadPool& GetShared();
+
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()> > tasks;
+        std::mutex mutex;
+        std::condition_variable available;
+        bool stopping;
+
+        void WorkerLoop();
+
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+    };
+
+    template <typename Task>
+    std::future<decltype(std::declval<Task&>()())> ThreadPool::Submit(Task task)
+    {
+        typedef decltype(task()) Result;
+
+        std::shared_ptr<std::packaged_task<Result()> > packaged =
+            std::make_shared<std::packaged_task<Result()> >(task);
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push([packaged]() { (*packaged)(); });
+        }
+        available.notify_one();
+        return result;
+    }
+}
+
+#endif /* ThreadPool_hpp */
@@ -0,0 +1,162 @@
+#include "VertexFormat.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace gps {
+
+    VertexQuantization EmptyQuantization()
+    {
+        VertexQuantization quantization;
+        quantization.positionMin = glm::vec3(FLT_MAX);
+        quantization.positionMax = glm::vec3(-FLT_MAX);
+        quantization.texCoordMin = glm::vec2(FLT_MAX);
+        quantization.texCoordMax = glm::vec2(-FLT_MAX);
+        return quantization;
+    }
+
+    void IncludeVertices(VertexQuantization& quantization, const Vertex* vertices, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            quantization.positionMin = glm::min(quantization.positionMin, vertices[i].Position);
+            quantization.positionMax = glm::max(quantization.positionMax, vertices[i].Position);
+            quantization.texCoordMin = glm::min(quantization.texCoordMin, vertices[i].TexCoords);
+            quantization.texCoordMax = glm::max(quantization.texCoordMax, vertices[i].TexCoords);
+        }
+    }
+
+    void AddQuantizationError(QuantizationError& total, const QuantizationError& error)
+    {
+        total.position = std::max(total.position, error.position);
+        total.normalDegrees = std::max(total.normalDegrees, error.normalDegrees);
+        total.texCoord = std::max(total.texCoord, error.texCoord);
+    }
+
+    bool IsWithinLimits(const QuantizationError& error, const VertexQuantization& quantization)
+    {
+        float diagonal = glm::length(quantization.positionMax - quantization.positionMin);
+        return error.position <= MAX_POSITION_ERROR * diagonal
+            && error.normalDegrees <= MAX_NORMAL_ERROR_DEGREES
+            && error.texCoord <= MAX_TEXCOORD_ERROR;
+    }
+
+    void FullVertexFormat::Encode(const Vertex& vertex, const VertexQuantization& quantization, GpuVertex& encoded)
+    {
+        encoded = vertex;
+    }
+
+    Vertex FullVertexFormat::Decode(const GpuVertex& encoded, const VertexQuantization& quantization)
+    {
+        return encoded;
+    }
+
+    void FullVertexFormat::SetupAttributes()
+    {
+        // Vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+        // Vertex Normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+        // Vertex Texture Coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+    }
+
+    glm::mat4 FullVertexFormat::GetPositionDecode(const VertexQuantization& quantization)
+    {
+        return glm::mat4(1.0f);
+    }
+
+    glm::vec4 FullVertexFormat::GetTexCoordDecode(const VertexQuantization& quantization)
+    {
+        return glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+    }
+
+    // flat boxes still need a nonzero scale to divide by
+    static glm::vec3 Extent(const glm::vec3& min, const glm::vec3& max)
+    {
+        return glm::max(max - min, glm::vec3(FLT_MIN));
+    }
+
+    static glm::vec2 Extent(const glm::vec2& min, const glm::vec2& max)
+    {
+        return glm::max(max - min, glm::vec2(FLT_MIN));
+    }
+
+    static GLushort ToUnorm16(float value)
+    {
+        return (GLushort)std::floor(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+
+    static GLuint ToSnorm10(float value)
+    {
+        return (GLuint)((int)std::floor(glm::clamp(value, -1.0f, 1.0f) * 511.0f + 0.5f) & 0x3ff);
+    }
+
+    static float FromSnorm10(GLuint bits)
+    {
+        // sign-extend the 10-bit field
+        int value = (int)(bits << 22) >> 22;
+        return std::max(value / 511.0f, -1.0f);
+    }
+
+    void PackedVertexFormat::Encode(const Vertex& vertex, const VertexQuantization& quantization, GpuVertex& encoded)
+    {
+        glm::vec3 position = (vertex.Position - quantization.positionMin) / Extent(quantization.positionMin, quantization.positionMax);
+        for (int c = 0; c < 3; c++) {
+            encoded.position[c] = ToUnorm16(position[c]);
+        }
+        encoded.padding = 0;
+
+        glm::vec3 normal = vertex.Normal;
+        float length = glm::length(normal);
+        if (length > 0.0f) {
+            normal /= length;
+        }
+        encoded.normal = ToSnorm10(normal.x) | ToSnorm10(normal.y) << 10 | ToSnorm10(normal.z) << 20;
+
+        glm::vec2 texCoords = (vertex.TexCoords - quantization.texCoordMin) / Extent(quantization.texCoordMin, quantization.texCoordMax);
+        encoded.texCoords[0] = ToUnorm16(texCoords.x);
+        encoded.texCoords[1] = ToUnorm16(texCoords.y);
+    }
+
+    Vertex PackedVertexFormat::Decode(const GpuVertex& encoded, const VertexQuantization& quantization)
+    {
+        Vertex vertex;
+        glm::vec3 position(encoded.position[0], encoded.position[1], encoded.position[2]);
+        vertex.Position = quantization.positionMin + position / 65535.0f * Extent(quantization.positionMin, quantization.positionMax);
+        vertex.Normal = glm::vec3(FromSnorm10(encoded.normal), FromSnorm10(encoded.normal >> 10), FromSnorm10(encoded.normal >> 20));
+        glm::vec2 texCoords(encoded.texCoords[0], encoded.texCoords[1]);
+        vertex.TexCoords = quantization.texCoordMin + texCoords / 65535.0f * Extent(quantization.texCoordMin, quantization.texCoordMax);
+        return vertex;
+    }
+
+    void PackedVertexFormat::SetupAttributes()
+    {
+        // Vertex Positions, 0..1 across the quantization box
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+        // Vertex Normals, the unused w lane is dropped by the vec3 input
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+        // Vertex Texture Coords, 0..1 across the quantization box
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, texCoords));
+    }
+
+    glm::mat4 PackedVertexFormat::GetPositionDecode(const VertexQuantization& quantization)
+    {
+        glm::mat4 decode = glm::translate(glm::mat4(1.0f), quantization.positionMin);
+        return glm::scale(decode, Extent(quantization.positionMin, quantization.positionMax));
+    }
+
+    glm::vec4 PackedVertexFormat::GetTexCoordDecode(const VertexQuantization& quantization)
+    {
+        glm::vec2 scale = Extent(quantization.texCoordMin, quantization.texCoordMax);
+        return glm::vec4(scale.x, scale.y, quantization.texCoordMin.x, quantization.texCoordMin.y);
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef VertexFormat_hpp
+#define VertexFormat_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+
+namespace gps {
+
+    // Vertex as loaded and kept on the CPU for culling, picking and simplification
+    struct Vertex
+    {
+        glm::vec3 Position;
+        glm::vec3 Normal;
+        glm::vec2 TexCoords;
+    };
+
+    // Box the packed positions and texture coordinates are stored relative to. One box
+    // is shared by every mesh of a model, so a single decode goes with its transform.
+    struct VertexQuantization
+    {
+        glm::vec3 positionMin;
+        glm::vec3 positionMax;
+        glm::vec2 texCoordMin;
+        glm::vec2 texCoordMax;
+    };
+
+    // Largest difference between the vertices and what the GPU decodes from them
+    struct QuantizationError
+    {
+        float position;       // in model units
+        float normalDegrees;
+        float texCoord;       // in texture repeats
+    };
+
+    // Errors above these count as visible: a hundredth of a percent of the model size,
+    // half a degree of shading normal, one texel of a 1024 texture
+    static const float MAX_POSITION_ERROR = 1e-4f;   // relative to the box diagonal
+    static const float MAX_NORMAL_ERROR_DEGREES = 0.5f;
+    static const float MAX_TEXCOORD_ERROR = 1.0f / 1024.0f;
+
+    // Empty box that grows with IncludeVertices
+    VertexQuantization EmptyQuantization();
+    void IncludeVertices(VertexQuantization& quantization, const Vertex* vertices, size_t count);
+
+    void AddQuantizationError(QuantizationError& total, const QuantizationError& error);
+    bool IsWithinLimits(const QuantizationError& error, const VertexQuantization& quantization);
+
+    // Vertex descriptors: the GPU vertex type, how to fill it and how the arena VAO
+    // reads it. The model matrix is multiplied by GetPositionDecode and the texture
+    // coordinates go through GetTexCoordDecode (scale in xy, offset in zw).
+
+    // Floats as loaded, 32 bytes
+    struct FullVertexFormat
+    {
+        typedef Vertex GpuVertex;
+
+        static void Encode(const Vertex& vertex, const VertexQuantization& quantization, GpuVertex& encoded);
+        static Vertex Decode(const GpuVertex& encoded, const VertexQuantization& quantization);
+        static void SetupAttributes();
+        static glm::mat4 GetPositionDecode(const VertexQuantization& quantization);
+        static glm::vec4 GetTexCoordDecode(const VertexQuantization& quantization);
+    };
+
+    // 16 bytes: positions and texture coordinates as 16-bit fractions of the
+    // quantization box, normals as signed 10_10_10_2
+    struct PackedVertex
+    {
+        GLushort position[3];
+        GLushort padding;
+        GLuint normal;
+        GLushort texCoords[2];
+    };
+
+    struct PackedVertexFormat
+    {
+        typedef PackedVertex GpuVertex;
+
+        static void Encode(const Vertex& vertex, const VertexQuantization& quantization, GpuVertex& encoded);
+        static Vertex Decode(const GpuVertex& encoded, const VertexQuantization& quantization);
+        static void SetupAttributes();
+        static glm::mat4 GetPositionDecode(const VertexQuantization& quantization);
+        static glm::vec4 GetTexCoordDecode(const VertexQuantization& quantization);
+    };
+
+#ifdef GPS_FULL_PRECISION_VERTICES
+    typedef FullVertexFormat GpuVertexFormat;
+#else
+    typedef PackedVertexFormat GpuVertexFormat;
+#endif
+    typedef GpuVertexFormat::GpuVertex GpuVertex;
+
+    // Fills encoded with the Format vertices and measures what the round trip loses
+    template <class Format>
+    QuantizationError EncodeVertices(const Vertex* vertices, size_t count, const VertexQuantization& quantization,
+        typename Format::GpuVertex* encoded)
+    {
+        QuantizationError error = { 0.0f, 0.0f, 0.0f };
+        for (size_t i = 0; i < count; i++) {
+            Format::Encode(vertices[i], quantization, encoded[i]);
+            Vertex decoded = Format::Decode(encoded[i], quantization);
+            QuantizationError vertexError;
+            vertexError.position = glm::length(decoded.Position - vertices[i].Position);
+            float normalLength = glm::length(vertices[i].Normal) * glm::length(decoded.Normal);
+            float cosine = normalLength > 0.0f ? glm::dot(vertices[i].Normal, decoded.Normal) / normalLength : 1.0f;
+            vertexError.normalDegrees = glm::degrees(std::acos(glm::clamp(cosine, -1.0f, 1.0f)));
+            glm::vec2 texCoordError = glm::abs(decoded.TexCoords - vertices[i].TexCoords);
+            vertexError.texCoord = glm::max(texCoordError.x, texCoordError.y);
+            AddQuantizationError(error, vertexError);
+        }
+        return error;
+    }
+}
+
+#endif /* VertexFormat_hpp */
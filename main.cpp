@@ -12,12 +12,37 @@
 #include "Camera.hpp"
 #include "Model3D.hpp"
 #include "SkyBox.hpp"
+#include "GeometryArena.hpp"
+#include "GLStateCache.hpp"
+#include "ImageOps.hpp"
+#include "PointShadows.hpp"
+#include "RenderQueue.hpp"
+#include "ShadowCascades.hpp"
+#include "TextureCache.hpp"
+#include "TextureLoader.hpp"
 
 #include <iostream>
 
 
-const unsigned int SHADOW_WIDTH = 8192;
-const unsigned int SHADOW_HEIGHT = 4096;
+// cascaded shadows of the directional light, one 1536x1536 array layer per cascade;
+// the cascades are fitted to the scene, so this matches 2048 around whole slices
+const int SHADOW_CASCADE_SIZE = 1536;
+// shadows reach this far from the camera, split with the practical scheme
+const float SHADOW_DISTANCE = 150.0f;
+const float SHADOW_SPLIT_LAMBDA = 0.75f;
+// shadow filtering compiled into basic.frag: 0 hard, 1 hardware 2x2 PCF,
+// 2 rotated-disk PCF, 3 PCSS; the disk has SHADOW_TAPS taps
+const int SHADOW_FILTER = 2;
+const int SHADOW_TAPS = 16;
+
+// point light shadows share one atlas, tiles sized by screen coverage (see PointShadows.hpp);
+// the lamp's light fades out well within this range
+const int POINT_SHADOW_ATLAS_SIZE = 4096;
+const float POINT_LIGHT_RANGE = 25.0f;
+
+// textures stream in after the first frame, at most this many bytes per frame
+const bool TEXTURE_STREAMING = true;
+const size_t TEXTURE_STREAMING_BUDGET = 8 * 1024 * 1024;
 
 // window
 gps::Window myWindow;
@@ -46,16 +71,16 @@ glm::mat3 normalMatrixTrumpet;
 glm::vec3 lightDir;
 glm::vec3 lightColor;
 
-// shader uniform locations
-GLint modelLoc;
-GLint viewLoc;
-GLint projectionLoc;
-GLint normalMatrixLoc;
-GLint lightDirLoc;
-GLint lightColorLoc;
-GLint lightDirMatrixLoc;
-
 bool day = true, waspressed = false, waspressed_fog = false, waspressed_point = false, onPoint = false;
+bool waspressed_stats = false;
+bool showCascades = false, waspressed_cascades = false;
+
+// uniform lookups, GL state changes and draw calls made during the last frame, printed with P
+gps::UniformStatistics frameUniforms;
+gps::GLStateStatistics frameState;
+gps::DrawStatistics frameDraws;
+gps::RenderQueueStatistics frameQueue;
+gps::Culling::CullStatistics frameCulling;
 
 // camera
 gps::Camera myCamera(
@@ -99,22 +124,28 @@ gps::Shader depthMapShader;
 
 //point lights
 glm::vec3 lightPos1; 
+// the lamp in the point shadow atlas
+size_t lampShadow;
 glm::vec3 pointLightColor;
-GLuint pointLightColorLoc;
-GLuint lightPos1Loc;
 
 //skybox
 gps::SkyBox skyBoxDay, skyBoxNight;
 
 //fog
 float fogDensity = 0;
-GLint fogDensityLoc;
 
-//shadows
-GLuint shadowMapFBO;
-GLuint shadowMapFBO2;
+//shadows, depth texture arrays with one framebuffer per layer
+gps::ShadowCascade shadowCascades[gps::SHADOW_CASCADE_COUNT];
+GLuint shadowMapFBO[gps::SHADOW_CASCADE_COUNT];
 GLuint depthMapTexture;
-GLuint depthMapTexture2;
+GLuint shadowCompareSampler, shadowDepthSampler;
+// static casters only, copied into the shadow map every frame
+GLuint staticShadowMapFBO[gps::SHADOW_CASCADE_COUNT];
+GLuint staticDepthMapTexture;
+// a cascade's cache is redrawn when its light space is refitted, which only static
+// boxes, the camera leaving the cached margin or a new light direction cause
+bool staticShadowDirty[gps::SHADOW_CASCADE_COUNT];
+size_t staticShadowRebuilds = 0;
 
 GLenum glCheckError_(const char *file, int line)
 {
@@ -158,12 +189,11 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
 	// set projection matrix
 	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 5000.0f);
 	//send matrix data to shader
-	GLint projLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+	myBasicShader.setMat4("projection", projection);
 
 	
 	// set Viewport transform
-	glViewport(0, 0, width, height);
+	gps::GLStateCache::GetInstance().Viewport(0, 0, width, height);
 }
 
 void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
@@ -200,7 +230,7 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 
 	view = myCamera.getViewMatrix();
 	myBasicShader.useShaderProgram();
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	myBasicShader.setMat4("view", view);
 	// compute normal matrix for teapot
 	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 
@@ -208,6 +238,45 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 	glfwSetCursorPos(window, window_width/2, window_height/2);
 }
 
+void printFrameStatistics() {
+	std::cout << "Uniform lookups: " << frameUniforms.driverLookups << " glGetUniformLocation, "
+		<< frameUniforms.cachedLookups << " cached in the last frame" << std::endl;
+	std::cout << "State changes  : " << frameState.issued << " issued, " << frameState.skipped
+		<< " skipped as redundant in the last frame" << std::endl;
+	std::cout << "Draw calls     : " << frameDraws.drawCalls << " for " << frameDraws.meshes
+		<< " meshes in the last frame" << std::endl;
+	std::cout << "Render queue   : " << frameQueue.draws << " draws, " << frameQueue.unsortedChanges
+		<< " switches in submission order, " << frameQueue.sortedChanges << " sorted" << std::endl;
+	// shadow numbers are summed over the cascades
+	size_t shadowVisible = 0, shadowCulled = 0, shadowTriangles = 0, shadowCulledTriangles = 0, staticTriangles = 0;
+	for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+		shadowVisible += frameCulling.visible[gps::ShadowPass(c)];
+		shadowCulled += frameCulling.culled[gps::ShadowPass(c)];
+		shadowTriangles += frameCulling.visibleTriangles[gps::ShadowPass(c)];
+		shadowCulledTriangles += frameCulling.culledTriangles[gps::ShadowPass(c)];
+		staticTriangles += frameCulling.visibleTriangles[gps::StaticShadowPass(c)];
+	}
+	std::cout << "Cascades       :";
+	for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+		std::cout << " " << shadowCascades[c].nearDistance << "-" << shadowCascades[c].farDistance
+			<< " (texel " << shadowCascades[c].texelSize << ", " << shadowCascades[c].sphereTexelSize << " untrimmed)";
+	}
+	std::cout << std::endl;
+	std::cout << "Culling        : shadow passes " << shadowVisible << " visible, "
+		<< shadowCulled << " culled; main pass " << frameCulling.visible[gps::MAIN_PASS]
+		<< " visible, " << frameCulling.culled[gps::MAIN_PASS] << " culled" << std::endl;
+	std::cout << "Shadow cache   : " << staticShadowRebuilds << " cascade rebuilds since startup, "
+		<< staticTriangles << " static caster triangles drawn in the last frame" << std::endl;
+	std::cout << "Triangles      : shadow passes " << shadowTriangles << " drawn, "
+		<< shadowCulledTriangles << " culled; main pass " << frameCulling.visibleTriangles[gps::MAIN_PASS]
+		<< " drawn, " << frameCulling.culledTriangles[gps::MAIN_PASS] << " outside the frustum, "
+		<< frameCulling.backfaceTriangles[gps::MAIN_PASS] << " in backfacing meshlets" << std::endl;
+	gps::PointShadowStatistics pointShadows = gps::PointShadowAtlas::GetInstance().GetStatistics();
+	std::cout << "Point shadows  : " << pointShadows.shadowed << " of " << pointShadows.lights << " lights in the atlas, "
+		<< pointShadows.rendered << " redrawn in the last frame (" << pointShadows.staticRendered << " with static casters), " << pointShadows.usedTexels * 100 / ((size_t)POINT_SHADOW_ATLAS_SIZE * POINT_SHADOW_ATLAS_SIZE)
+		<< "% of the atlas used" << std::endl;
+}
+
 void processMovement() {
 	// rotate camera to the right
 	if (pressedKeys[GLFW_KEY_C]) {
@@ -219,7 +288,7 @@ void processMovement() {
 
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.setMat4("view", view);
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
@@ -233,7 +302,7 @@ void processMovement() {
 
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.setMat4("view", view);
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
@@ -243,7 +312,7 @@ void processMovement() {
 		//update view matrix
         view = myCamera.getViewMatrix();
         myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        myBasicShader.setMat4("view", view);
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
@@ -253,7 +322,7 @@ void processMovement() {
         //update view matrix
         view = myCamera.getViewMatrix();
         myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        myBasicShader.setMat4("view", view);
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
@@ -263,7 +332,7 @@ void processMovement() {
         //update view matrix
         view = myCamera.getViewMatrix();
         myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        myBasicShader.setMat4("view", view);
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
@@ -274,20 +343,20 @@ void processMovement() {
         //update view matrix
         view = myCamera.getViewMatrix();
         myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        myBasicShader.setMat4("view", view);
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 	rmat = glm::mat4(1.0f);
 
 	if (pressedKeys[GLFW_KEY_2]) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		gps::GLStateCache::GetInstance().PolygonMode(GL_LINE);
 	}
 	if (pressedKeys[GLFW_KEY_3]) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+		gps::GLStateCache::GetInstance().PolygonMode(GL_POINT);
 	}
 	if (pressedKeys[GLFW_KEY_4]) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		gps::GLStateCache::GetInstance().PolygonMode(GL_FILL);
 	}
 
 	if (pressedKeys[GLFW_KEY_1]) {
@@ -302,9 +371,7 @@ void processMovement() {
 			}
 			myBasicShader.useShaderProgram();
 
-			//fog density location
-			fogDensityLoc = glGetUniformLocation(myBasicShader.shaderProgram, "fogDensity");
-			glUniform1f(fogDensityLoc, (GLfloat)fogDensity);
+			myBasicShader.setFloat("fogDensity", (GLfloat)fogDensity);
 
 		}
 		waspressed_fog = false;
@@ -321,16 +388,14 @@ void processMovement() {
 			if (onPoint) {
 				pointLightColor = glm::vec3(0.0f, 0.0f, 0.0f); //no light for off lights
 
-				pointLightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightColor");
-				glUniform3fv(pointLightColorLoc, 1, glm::value_ptr(pointLightColor));
+				myBasicShader.setVec3("pointLightColor", pointLightColor);
 				onPoint = false;
 			}
 			else {
 				onPoint = true;
 				pointLightColor = glm::vec3(0.2f, 0.2f, 0.0f); //yellow light
 
-				pointLightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightColor");
-				glUniform3fv(pointLightColorLoc, 1, glm::value_ptr(pointLightColor));
+				myBasicShader.setVec3("pointLightColor", pointLightColor);
 
 			}
 			waspressed_point = false;
@@ -347,20 +412,37 @@ void processMovement() {
 			if (day) {
 				lightColor = glm::vec3(0.05f, 0.05f, 0.3f); //blueish dim night light
 
-				lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-				glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
+				myBasicShader.setVec3("lightColor", lightColor);
 				day = false;
 			}
 			else {
 				day = true;
 				lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
 
-				lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-				glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
+				myBasicShader.setVec3("lightColor", lightColor);
 			}
 			waspressed = false;
 		}
 
+	// tint the scene by shadow cascade
+	if (pressedKeys[GLFW_KEY_V]) {
+		waspressed_cascades = true;
+	}
+	else
+		if (waspressed_cascades) {
+			showCascades = !showCascades;
+			waspressed_cascades = false;
+		}
+
+	if (pressedKeys[GLFW_KEY_P]) {
+		waspressed_stats = true;
+	}
+	else
+		if (waspressed_stats) {
+			printFrameStatistics();
+			waspressed_stats = false;
+		}
+
 	rmat = glm::rotate(rmat, glm::radians(angleX), glm::vec3(0, 1, 0));
 	rmat = glm::rotate(rmat, glm::radians(angleY), glm::vec3(1, 0, 0));
 
@@ -369,6 +451,35 @@ void processMovement() {
 
 }
 
+// casts a ray from the camera through the middle of the screen and reports the closest object
+void pickObject() {
+	const char* names[] = { "scene", "hour hand", "minute hand", "second hand", "bridge", "trumpet" };
+	gps::Model3D* objects[] = { &scene, &hour, &min, &sec, &bridge, &trumpet };
+	glm::mat4 transforms[] = { model, model_hour, model_min, model_sec, model_bridge, model_trumpet };
+
+	// the view matrix looks along cameraFrontDirection
+	glm::vec3 direction = myCamera.cameraFrontDirection;
+	float distance = 1000.0f;
+	int picked = -1;
+	for (int i = 0; i < 6; i++) {
+		if (objects[i]->Raycast(myCamera.cameraPosition, direction, transforms[i], distance)) {
+			picked = i;
+		}
+	}
+
+	if (picked >= 0) {
+		std::cout << "Picked         : " << names[picked] << " at " << distance << std::endl;
+	} else {
+		std::cout << "Picked         : nothing" << std::endl;
+	}
+}
+
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+		pickObject();
+	}
+}
+
 void initOpenGLWindow() {
     myWindow.Create(1024, 768, "OpenGL Project Core");
 }
@@ -378,6 +489,7 @@ void setWindowCallbacks() {
     glfwSetKeyCallback(myWindow.getWindow(), keyboardCallback);
 	glfwSetInputMode(myWindow.getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(myWindow.getWindow(), mouseCallback);
+	glfwSetMouseButtonCallback(myWindow.getWindow(), mouseButtonCallback);
 }
 
 void initOpenGLState() {
@@ -401,10 +513,20 @@ void initModels() {
 	bridge.LoadModel("models/my_scene/my_bridge_placed.obj");
 }
 
+void uploadTextures() {
+	// the model and skybox images have been decoding in the background since they were requested
+	if (gps::TextureUploader::GetInstance().IsStreaming()) {
+		return; // the render loop uploads them a slice at a time
+	}
+	gps::TextureUploader::GetInstance().Flush();
+	gps::TextureCache::GetInstance().PrintStatistics();
+}
+
 void initShaders() {
 	myBasicShader.loadShader(
         "shaders/basic.vert",
-        "shaders/basic.frag");
+        "shaders/basic.frag",
+		"#define SHADOW_FILTER " + std::to_string(SHADOW_FILTER) + "\n#define SHADOW_TAPS " + std::to_string(SHADOW_TAPS));
 	skyboxShader.loadShader(
 		"shaders/skyboxShader.vert", 
 		"shaders/skyboxShader.frag");
@@ -416,132 +538,146 @@ void initShaders() {
 		"shaders/depthMapShader.frag");
 }
 
-void initFBO()
+// depth texture array with a framebuffer for each layer
+GLuint initShadowArray(GLuint* framebuffers)
 {
-	//generate FBO ID
-	glGenFramebuffers(1, &shadowMapFBO);
-
-	//create depth texture for FBO
-	glGenTextures(1, &depthMapTexture);
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-		SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	//attach texture to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT,
+		SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE, gps::SHADOW_CASCADE_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(gps::SHADOW_CASCADE_COUNT, framebuffers);
+	for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[c]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, c);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return texture;
 }
 
-void initFBO2()
+void initFBO()
 {
-	//generate FBO ID
-	glGenFramebuffers(1, &shadowMapFBO2);
-
-	//create depth texture for FBO
-	glGenTextures(1, &depthMapTexture2);
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture2);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-		SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	//attach texture to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO2);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture2, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	depthMapTexture = initShadowArray(shadowMapFBO);
+
+	// the main pass reads the array through two samplers: depth comparison with
+	// bilinear filtering on unit 3, raw depths on unit 4
+	glGenSamplers(1, &shadowCompareSampler);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindSampler(3, shadowCompareSampler);
+
+	glGenSamplers(1, &shadowDepthSampler);
+	glSamplerParameteri(shadowDepthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glSamplerParameteri(shadowDepthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glSamplerParameteri(shadowDepthSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(shadowDepthSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindSampler(4, shadowDepthSampler);
+	// the point shadow atlas on unit 5 compares the same way
+	glBindSampler(5, shadowCompareSampler);
+}
+
+void initStaticShadowFBO()
+{
+	staticDepthMapTexture = initShadowArray(staticShadowMapFBO);
+	for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+		staticShadowDirty[c] = true;
+	}
 }
 
 void initUniforms() {
 	myBasicShader.useShaderProgram();
 
-
-	lightDirMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDirMatrix");
-
     // create model matrix for teapot
     model = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
 
 	// get view matrix for current camera
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
 	// send view matrix to shader
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	myBasicShader.setMat4("view", view);
 
     // compute normal matrix for teapot
     normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-	normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
 
 	// create projection matrix
 	projection = glm::perspective(glm::radians(45.0f),
                                (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
                                0.1f, 300.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
 	// send projection matrix to shader
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));	
+	myBasicShader.setMat4("projection", projection);
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(0.0f, 150.0f, 150.0f);
-	lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
 	// send light dir to shader
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
+	myBasicShader.setVec3("lightDir", lightDir);
 
 	//set light color
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
 	// send light color to shader
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
+	myBasicShader.setVec3("lightColor", lightColor);
 
 	//point light 1 position
 	//lightPos1 = glm::vec3(-24.96f, 3.414f, 19.47f); // position of light pole
 	lightPos1 = glm::vec3(6.358771,3.479532,3.922943); // position of light pole
-	lightPos1Loc = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightPosition");
-	glUniform3fv(lightPos1Loc, 1, glm::value_ptr(lightPos1));
+	myBasicShader.setVec3("pointLightPosition", lightPos1);
+	lampShadow = gps::PointShadowAtlas::GetInstance().AddLight(lightPos1, POINT_LIGHT_RANGE);
 	
 	//point light color
 	pointLightColor = glm::vec3(0.0f, 0.0f, 0.0f); //point lights start as off
-	pointLightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightColor");
 	// send light color to shader
-	glUniform3fv(pointLightColorLoc, 1, glm::value_ptr(pointLightColor));
+	myBasicShader.setVec3("pointLightColor", pointLightColor);
 
-	//fog density location
-	fogDensityLoc = glGetUniformLocation(myBasicShader.shaderProgram, "fogDensity");
-	glUniform1f(fogDensityLoc, (GLfloat)fogDensity);
+	//fog density
+	myBasicShader.setFloat("fogDensity", (GLfloat)fogDensity);
 
 }
 
-glm::mat4 computeLightSpaceTrMatrix()
+// a model placed for this frame; submission waits until every model is placed,
+// since the cascades are fitted around all of them
+struct SceneObject {
+	gps::Model3D* object;
+	glm::mat4 modelMatrix;
+	glm::mat3 normalMatrix;
+	bool staticCaster;
+	// its mesh boxes in sceneBounds
+	size_t firstBounds, endBounds;
+};
+std::vector<SceneObject> sceneObjects;
+// world-space boxes of the placed meshes; the cascades are fitted to the static ones
+// only, so moving models do not invalidate the cached static shadows
+std::vector<gps::Bounds> sceneBounds;
+std::vector<gps::Bounds> staticSceneBounds;
+
+// fits the cascades to the camera frustum and the static models, called once per frame;
+// a cascade keeps its light space while it still covers the tight fit
+void updateShadowCascades()
 {
-	const GLfloat near_plane = 50.0f, far_plane = 300.0f;
-	glm::mat4 lightProjection = glm::ortho(-150.0f, 150.0f, -150.0f, 150.0f, near_plane, far_plane);
-
-	glm::vec3 lightDirTr = glm::vec3(glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(lightDir, 1.0f));
-	glm::mat4 lightView = glm::lookAt(lightDirTr, myCamera.getCameraTarget(), glm::vec3(0.0f, 1.0f, 0.0f));
-
-	return lightProjection * lightView;
-}
-
-glm::mat4 computePosLightSpaceTrMatrix()
-{
-	const GLfloat near_plane = 1.0f, far_plane = 100.0f;
-	glm::mat4 lightProjection = glm::perspective(glm::radians(45.0f),
-		(float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
-		near_plane, far_plane);
-
-	glm::vec3 lightDirTr = glm::vec3(glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(lightPos1, 1.0f));
-	glm::mat4 lightView = glm::lookAt(lightDirTr, myCamera.getCameraTarget(), glm::vec3(0.0f, 1.0f, 0.0f));
-
-	return lightProjection * lightView;
+	float splits[gps::SHADOW_CASCADE_COUNT + 1];
+	// near plane and field of view of the camera projection
+	gps::ComputeCascadeSplits(0.1f, SHADOW_DISTANCE, SHADOW_SPLIT_LAMBDA, splits);
+
+	glm::mat4 inverseView = glm::inverse(view);
+	float aspect = (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height;
+	for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+		gps::ShadowCascade tight = gps::FitCascade(inverseView, glm::radians(45.0f), aspect, splits[c], splits[c + 1],
+			lightDir, SHADOW_CASCADE_SIZE, staticSceneBounds.data(), staticSceneBounds.size());
+		gps::ShadowCascade padded = gps::FitCascade(inverseView, glm::radians(45.0f), aspect, splits[c], splits[c + 1],
+			lightDir, SHADOW_CASCADE_SIZE, staticSceneBounds.data(), staticSceneBounds.size(), gps::SHADOW_CACHE_MARGIN_STEPS);
+		if (!gps::CanKeepCascade(shadowCascades[c], tight, padded)) {
+			shadowCascades[c] = padded;
+			staticShadowDirty[c] = true;
+		}
+	}
 }
 
 void initSkyBox()
@@ -567,102 +703,156 @@ void initSkyBox()
 
 	skyBoxNight.Load(faces2);
 }
-/*
-void renderTeapot(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    //send teapot model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-    //send teapot normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-    // draw teapot
-    //teapot.Draw(shader);
+// the queue sorts opaque draws front to back by the depth of the model origin
+float viewDepth(const glm::mat4& modelMatrix) {
+	return -(view * modelMatrix[3]).z;
 }
-*/
-void renderScene_env(gps::Shader shader) {
-	// select active shader program
-	shader.useShaderProgram();
 
-	//send scene model matrix data to shader
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	//send scene normal matrix data to shader
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw teapot
-	scene.Draw(shader);
+float lightDepth(const glm::mat4& lightSpaceTrMatrix, const glm::mat4& modelMatrix) {
+	return (lightSpaceTrMatrix * modelMatrix[3]).z * 0.5f + 0.5f;
 }
 
-void renderHour(gps::Shader shader)
-{
-
-	shader.useShaderProgram();
-
-	//send scene model matrix data to shader
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model_hour));
-
-	//send scene normal matrix data to shader
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrixHour));
-
-	hour.Draw(shader);
+// frustums of the shadow cascades and the camera for this frame
+gps::Culling::Frustum cascadeFrustums[gps::SHADOW_CASCADE_COUNT], cameraFrustum;
+
+// records a model and its mesh boxes for this frame
+void placeModel(gps::Model3D& object, const glm::mat4& modelMatrix, const glm::mat3& objectNormalMatrix,
+	bool staticCaster) {
+	SceneObject placed = { &object, modelMatrix, objectNormalMatrix, staticCaster, sceneBounds.size(), 0 };
+	object.AddWorldBounds(modelMatrix, sceneBounds);
+	placed.endBounds = sceneBounds.size();
+	if (staticCaster) {
+		staticSceneBounds.insert(staticSceneBounds.end(), sceneBounds.begin() + placed.firstBounds, sceneBounds.end());
+	}
+	sceneObjects.push_back(placed);
 }
 
-void renderMin(gps::Shader shader)
-{
-
-	shader.useShaderProgram();
-
-	//send scene model matrix data to shader
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model_min));
-
-	//send scene normal matrix data to shader
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrixMin));
-
-	min.Draw(shader);
+// queues a model for every shadow cascade and the main pass, sharing one transform; static
+// casters go to the cached shadow maps, and only on the frames a cascade is rebuilt
+void submitModel(const SceneObject& placed) {
+	gps::Model3D& object = *placed.object;
+	const glm::mat4& modelMatrix = placed.modelMatrix;
+	bool staticCaster = placed.staticCaster;
+	gps::RenderQueue& queue = gps::RenderQueue::GetInstance();
+	// the packed vertices are decoded by the model matrix itself, culling keeps the plain one
+	size_t transform = queue.AddTransform(modelMatrix * object.GetPositionDecode(), placed.normalMatrix, object.GetTexCoordDecode());
+	// one unit at distance one covers projection[1][1] * height / 2 pixels
+	object.SelectLods(modelMatrix, myCamera.cameraPosition, projection[1][1] * myWindow.getWindowDimensions().height * 0.5f);
+	// the light is orthographic, so only the camera pass rejects backfacing meshlets
+	for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+		if (!staticCaster || staticShadowDirty[c]) {
+			object.Submit(queue, staticCaster ? gps::StaticShadowPass(c) : gps::ShadowPass(c), depthMapShader, transform,
+				modelMatrix, cascadeFrustums[c], NULL, lightDepth(shadowCascades[c].lightSpace, modelMatrix), false);
+		}
+	}
+	object.Submit(queue, gps::MAIN_PASS, myBasicShader, transform, modelMatrix, cameraFrustum, &myCamera.cameraPosition,
+		viewDepth(modelMatrix), true);
 }
 
-void renderSec(gps::Shader shader)
-{
-
-	shader.useShaderProgram();
-
-	//send scene model matrix data to shader
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model_sec));
-
-	//send scene normal matrix data to shader
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrixSec));
-
-	sec.Draw(shader);
+// draws the meshes of the static or the moving placed models that reach into the sphere
+// into the point shadow atlas, skipping models with no mesh box inside it
+void drawPointShadowCasters(const gps::Shader& shader, const glm::vec3& center, float radius, bool staticCasters) {
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		const SceneObject& placed = sceneObjects[i];
+		if (placed.staticCaster != staticCasters) {
+			continue;
+		}
+		bool reached = false;
+		for (size_t b = placed.firstBounds; b < placed.endBounds && !reached; b++) {
+			glm::vec3 closest = glm::clamp(center, sceneBounds[b].min, sceneBounds[b].max);
+			reached = glm::dot(closest - center, closest - center) <= radius * radius;
+		}
+		if (reached) {
+			shader.setMat4("model", placed.modelMatrix * placed.object->GetPositionDecode());
+			placed.object->DrawDepth(placed.modelMatrix, center, radius);
+		}
+	}
 }
 
-void renderBridge(gps::Shader shader)
-{
-
-	shader.useShaderProgram();
-
-	//send scene model matrix data to shader
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model_bridge));
-
-	//send scene normal matrix data to shader
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrixBridge));
-
-	bridge.Draw(shader);
+// sizes, packs and redraws the point light shadows for this frame
+void updatePointShadows() {
+	gps::PointShadowAtlas& atlas = gps::PointShadowAtlas::GetInstance();
+	atlas.SetLight(lampShadow, lightPos1, POINT_LIGHT_RANGE, onPoint);
+	atlas.Update(myCamera.cameraPosition, projection[1][1] * myWindow.getWindowDimensions().height * 0.5f);
+	atlas.Render(drawPointShadowCasters);
 }
 
-void renderTrumpet(gps::Shader shader)
-{
-	shader.useShaderProgram();
+void initRenderPasses() {
+	gps::RenderQueue& queue = gps::RenderQueue::GetInstance();
 
-	//send scene model matrix data to shader
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model_trumpet));
+	for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+		// 1st step: static casters into the cascade's cached depth layer, when it is out of date
+		queue.SetPassSetup(gps::StaticShadowPass(c), [c]() {
+			if (!staticShadowDirty[c]) {
+				return;
+			}
+			staticShadowRebuilds++;
+			depthMapShader.useShaderProgram();
+			depthMapShader.setMat4("lightSpaceTrMatrix", shadowCascades[c].lightSpace);
+
+			gps::GLStateCache::GetInstance().Viewport(0, 0, SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE);
+			gps::GLStateCache::GetInstance().BindFramebuffer(staticShadowMapFBO[c]);
+
+			// casters nearer the light than the near plane land on it instead of being clipped
+			glEnable(GL_DEPTH_CLAMP);
+			glClear(GL_DEPTH_BUFFER_BIT);
+		});
+
+		// 2nd step: copy the cached depth into the cascade's layer and add the moving casters
+		queue.SetPassSetup(gps::ShadowPass(c), [c]() {
+			depthMapShader.useShaderProgram();
+			depthMapShader.setMat4("lightSpaceTrMatrix", shadowCascades[c].lightSpace);
+
+			gps::GLStateCache::GetInstance().Viewport(0, 0, SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE);
+			gps::GLStateCache::GetInstance().BindFramebuffer(shadowMapFBO[c]);
+
+			// the state cache binds both targets, so the read side is put back after the copy
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, staticShadowMapFBO[c]);
+			glBlitFramebuffer(0, 0, SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE, 0, 0, SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE,
+				GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, shadowMapFBO[c]);
+			glEnable(GL_DEPTH_CLAMP);
+		});
+	}
 
-	//send scene normal matrix data to shader
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrixTrumpet));
+	// 3rd step: render the scene
+	queue.SetPassSetup(gps::MAIN_PASS, []() {
+		gps::GLStateCache::GetInstance().BindFramebuffer(0);
+		gps::GLStateCache::GetInstance().Viewport(0, 0, (int)myWindow.getWindowDimensions().width, (int)myWindow.getWindowDimensions().height);
+
+		glDisable(GL_DEPTH_CLAMP);
+		myBasicShader.useShaderProgram();
 
-	trumpet.Draw(shader);
+		// send the cascades to the shader, picked per fragment by view depth
+		glm::mat4 cascadeLightSpace[gps::SHADOW_CASCADE_COUNT];
+		glm::vec4 cascadeSplits, cascadeTexelSizes;
+		for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+			cascadeLightSpace[c] = shadowCascades[c].lightSpace;
+			cascadeSplits[c] = shadowCascades[c].farDistance;
+			cascadeTexelSizes[c] = shadowCascades[c].texelSize;
+		}
+		myBasicShader.setMat4Array("cascadeLightSpace", cascadeLightSpace, gps::SHADOW_CASCADE_COUNT);
+		myBasicShader.setVec4("cascadeSplits", cascadeSplits);
+		myBasicShader.setVec4("cascadeTexelSizes", cascadeTexelSizes);
+		myBasicShader.setInt("showCascades", showCascades);
+
+		myBasicShader.setMat4("view", view);
+
+		// send lightDir matrix data to shader
+		myBasicShader.setMat3("lightDirMatrix", glm::mat3(lightDirMatrix));
+
+		// bind the depth map
+		gps::GLStateCache::GetInstance().BindTexture(3, GL_TEXTURE_2D_ARRAY, depthMapTexture);
+		gps::GLStateCache::GetInstance().BindTexture(4, GL_TEXTURE_2D_ARRAY, depthMapTexture);
+		myBasicShader.setInt("shadowMap", 3);
+		myBasicShader.setInt("shadowDepth", 4);
+
+		// and the point shadow atlas
+		gps::PointShadowAtlas& atlas = gps::PointShadowAtlas::GetInstance();
+		gps::GLStateCache::GetInstance().BindTexture(5, GL_TEXTURE_2D, atlas.GetTexture());
+		myBasicShader.setInt("pointShadowAtlas", 5);
+		myBasicShader.setVec4("pointShadowTile", atlas.GetShadowTile(lampShadow));
+	});
 }
 
 int br = 0, tr = 0;
@@ -671,170 +861,55 @@ void renderScene() {
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	depthMapShader.useShaderProgram();
-	
-	// compute shadows for directional light
-	glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"),
-		1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
+	// view matrix for this frame
+	view = myCamera.getViewMatrix();
 
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
+	// compute light direction transformation matrix
+	lightDirMatrix = glm::mat3(glm::inverseTranspose(view));
 
-	glClear(GL_DEPTH_BUFFER_BIT);
+	cameraFrustum = gps::Culling::ExtractFrustum(projection * view);
 
-	//compute shadows for objects
-	//shadow for scene environment
-	depthMapShader.useShaderProgram();
-	glm::mat4 model_shadow = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0, 1.0, 0.0));
-	glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model_shadow));
-	renderScene_env(depthMapShader);
+	//scene environment
+	model = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f));
+	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+	placeModel(scene, model, normalMatrix, true);
 
 	////// rotatiiiiiiii
-	glm::vec3 ax_tr, ax_br, ax_clk;
-	ax_clk = glm::vec3(7.000524,2.800706,-2.404608)- glm::vec3(7.000524,2.800706,-2.400560);
-	//shadow for hour tongue
-	
+	glm::vec3 ax_tr, ax_br;
+
+	//hour tongue
 	model_hour = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f));
 	model_hour = glm::translate(model_hour, glm::vec3(-6.528f, 0.0f, -5.305f));
 	model_hour = glm::rotate(model_hour, glm::radians(angleHour), glm::vec3(0.0f, 1.0f, 0.0f));
 	model_hour = glm::translate(model_hour, glm::vec3(6.528f, 0.0, 5.305f));
 	normalMatrixHour = glm::mat3(glm::inverseTranspose(view * model_hour));
-	
-	renderHour(depthMapShader);
+	placeModel(hour, model_hour, normalMatrixHour, false);
 
-	//shadow for min tongue
-	
+	//min tongue
 	model_min = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f));
 	model_min = glm::translate(model_min, glm::vec3(-6.528f, 0.0f, -5.305f));
 	model_min = glm::rotate(model_min, glm::radians(angleMin), glm::vec3(0.0f, 1.0f, 0.0f));
 	model_min = glm::translate(model_min, glm::vec3(6.528f, 0.0, 5.305f));
 	normalMatrixMin = glm::mat3(glm::inverseTranspose(view * model_min));
+	placeModel(min, model_min, normalMatrixMin, false);
 
-	renderMin(depthMapShader);
-
-	//shadow for sec tongue
+	//sec tongue
 	model_sec = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f));
 	model_sec = glm::translate(model_sec, glm::vec3(-6.528f, 0.0f, -5.305f));
 	model_sec = glm::rotate(model_sec, glm::radians(angleSec), glm::vec3(0.0f, 1.0f, 0.0f));
 	model_sec = glm::translate(model_sec, glm::vec3(6.528f, 0.0, 5.305f));
 	normalMatrixSec = glm::mat3(glm::inverseTranspose(view * model_sec));
+	placeModel(sec, model_sec, normalMatrixSec, false);
 
-	renderSec(depthMapShader);
-
-	//shadow for trumpet
-	
-	ax_tr = glm::vec3(0.0, 0.0, 1.0);
-	model_trumpet = glm::translate(glm::mat4(1.0f), glm::vec3(-2.181660, -4.080528, -5.187709));
-	model_trumpet = glm::rotate(model_trumpet, glm::radians(angleTrumpet), ax_tr);
-	model_trumpet = glm::translate(model_trumpet, glm::vec3(2.181660, 4.080528, 5.187709));
-	normalMatrixTrumpet = glm::mat3(glm::inverseTranspose(view * model_trumpet));
-	renderTrumpet(depthMapShader);
-
-	//shadow for bridge
+	//bridge
 	ax_br = glm::vec3(-7.989387, 0.281455, 8.464755) - glm::vec3(-7.711543, 0.270463, 9.117801);
 	model_bridge = glm::translate(glm::mat4(1.0f), glm::vec3(-7.989387, 0.281455, 8.464755));
 	model_bridge = glm::rotate(model_bridge, glm::radians(angleBridge), ax_br);
 	model_bridge = glm::translate(model_bridge, glm::vec3(7.989387, -0.281455, -8.464755));
 	normalMatrixBridge = glm::mat3(glm::inverseTranspose(view * model_bridge));
-	
-
-	renderBridge(depthMapShader);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	// 2nd step: render the scene
-
-	myBasicShader.useShaderProgram();
-
-	// send lightSpace matrix to shader
-	glUniformMatrix4fv(glGetUniformLocation(myBasicShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
-
-	// send view matrix to shader
-	view = myCamera.getViewMatrix();
-
-	glUniformMatrix4fv(glGetUniformLocation(myBasicShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-
-	// compute light direction transformation matrix
-	lightDirMatrix = glm::mat3(glm::inverseTranspose(view));
-	// send lightDir matrix data to shader
-
-	lightDirMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDirMatrix");
-	glUniformMatrix3fv(lightDirMatrixLoc, 1, GL_FALSE, glm::value_ptr(lightDirMatrix));
+	placeModel(bridge, model_bridge, normalMatrixBridge, false);
 
-	glViewport(0, 0, (int)myWindow.getWindowDimensions().width, (int)myWindow.getWindowDimensions().height);
-	myBasicShader.useShaderProgram();
-
-	// bind the depth map
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-	glUniform1i(glGetUniformLocation(myBasicShader.shaderProgram, "shadowMap"), 3);
-
-	//render the scene
-
-	model = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
-	renderScene_env(myBasicShader);
-
-	// aici erau pt translatare aka miscare pe axa , nu cred ca mi trebe
-	
-	// update normal matrix for hour
-	//model_hour = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f));
-	/*
-	model_hour = glm::translate(glm::mat4(1.0f), glm::vec3(-7.003437,-2.802224,2.423554));
-	model_hour = glm::rotate(model_hour, glm::radians(angleHour), ax_clk);
-	model_hour = glm::translate(model_hour, glm::vec3(7.003437, 2.802224, -2.423554));
-	normalMatrixHour = glm::mat3(glm::inverseTranspose(view * model_hour));
-	
-	//compute next angle for hour
-
-	angleHour += 0.3f;
-	if (angleHour > 360.0)
-		angleHour -= 360;
-		*/
-	renderHour(myBasicShader);
-
-	// update normal matrix for min
-	//model_min = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), ax_clk);
-	/*
-	model_min = glm::translate(glm::mat4(1.0f), glm::vec3(-7.000524,-2.800706,2.400560));
-	model_min = glm::rotate(model_min, glm::radians(angleMin), ax_clk);
-	model_min = glm::translate(model_min, glm::vec3(7.000524, 2.800706, -2.400560));
-	normalMatrixMin = glm::mat3(glm::inverseTranspose(view * model_min));
-
-	//compute next angle for min
-
-	angleMin += 0.3f;
-	if (angleMin > 360.0)
-		angleMin -= 360;
-	*/
-	renderMin(myBasicShader);
-
-	// update normal matrix for sec
-	/*
-	model_sec = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f));
-	model_sec = glm::translate(model_sec, glm::vec3(-6.528f, 0.0f, -5.305f));
-	model_sec = glm::rotate(model_sec, glm::radians(angleSec), glm::vec3(0.0f, 1.0f, 0.0f));
-	model_sec = glm::translate(model_sec, glm::vec3(6.528f, 0.0, 5.305f));
-	normalMatrixSec = glm::mat3(glm::inverseTranspose(view * model_sec));
-
-	//compute next angle for sec
-
-	angleSec += 0.3f;
-	if (angleSec > 360.0)
-		angleSec -= 360;
-		*/
-	renderSec(myBasicShader);
-
-	// update normal matrix for bridge
-	//model_bridge = glm::translate(model_bridge, glm::vec3(-7.989387, 0.281455, 8.464755)) * glm::translate(model_bridge, glm::vec3(7.989387, -0.281455, -8.464755));
-	
-	//model_bridge = glm::rotate(glm::mat4(1.0f), glm::radians((GLfloat)0), glm::vec3(0.0f, 1.0f, 0.0f));
-	model_bridge = glm::translate(glm::mat4(1.0f), glm::vec3(-7.989387, 0.281455, 8.464755));
-	model_bridge = glm::rotate(model_bridge, glm::radians(angleBridge), ax_br);
-	model_bridge = glm::translate(model_bridge, glm::vec3(7.989387, -0.281455, -8.464755));
-	normalMatrixBridge = glm::mat3(glm::inverseTranspose(view * model_bridge));
 	//compute next angle for bridge
-
 	if (br == 0) {
 		angleBridge -= 0.1f;
 		if (angleBridge < -75)
@@ -846,15 +921,13 @@ void renderScene() {
 			br = 0;
 	}
 
-	renderBridge(myBasicShader);
-
-	// update normal matrix for trumpet
-
-	//glm::vec3 ax = glm::vec3(-7.989387, 0.281455, 8.464755) - glm::vec3(2.181660,4.080528,5.187709);
+	//trumpet
+	ax_tr = glm::vec3(0.0, 0.0, 1.0);
 	model_trumpet = glm::translate(glm::mat4(1.0f), glm::vec3(-2.181660,-4.080528,-5.187709));
 	model_trumpet = glm::rotate(model_trumpet, glm::radians(angleTrumpet), ax_tr);
 	model_trumpet = glm::translate(model_trumpet, glm::vec3(2.181660, 4.080528, 5.187709));
 	normalMatrixTrumpet = glm::mat3(glm::inverseTranspose(view * model_trumpet));
+	placeModel(trumpet, model_trumpet, normalMatrixTrumpet, false);
 
 	//compute next angle for trumpet
 	if (tr == 0) {
@@ -868,7 +941,25 @@ void renderScene() {
 			tr = 0;
 	}
 
-	renderTrumpet(myBasicShader);
+	updateShadowCascades();
+	for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+		cascadeFrustums[c] = gps::Culling::ExtractFrustum(shadowCascades[c].lightSpace);
+		// with depth clamping the near plane culls nothing
+		cascadeFrustums[c].planes[4] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		submitModel(sceneObjects[i]);
+	}
+	updatePointShadows();
+	sceneObjects.clear();
+	sceneBounds.clear();
+	staticSceneBounds.clear();
+
+	// shadow passes, then main pass, each sorted by shader, textures and depth
+	gps::RenderQueue::GetInstance().Flush();
+	for (int c = 0; c < gps::SHADOW_CASCADE_COUNT; c++) {
+		staticShadowDirty[c] = false;
+	}
 
 	//render skybox
 	if(day)
@@ -878,6 +969,11 @@ void renderScene() {
 }
 
 void cleanup() {
+	// while the context and the texture cache are still alive
+	gps::Model3D* objects[] = { &scene, &hour, &min, &sec, &bridge, &trumpet };
+	for (int i = 0; i < 6; i++) {
+		objects[i]->ReleaseTextures();
+	}
     myWindow.Delete();
     //cleanup code for your own data
 }
@@ -893,21 +989,65 @@ int main(int argc, const char * argv[]) {
 
 	rmat = glm::mat4(1.0f);
 
+#ifdef GPS_BENCHMARK_IMAGE_OPS
+	gps::ImageOps::RunBenchmark();
+#endif
+
     initOpenGLState();
 	initFBO();
-	//initFBO2();
+	initStaticShadowFBO();
+	gps::PointShadowAtlas::GetInstance().Init(POINT_SHADOW_ATLAS_SIZE);
+	gps::TextureUploader::GetInstance().SetStreaming(TEXTURE_STREAMING, TEXTURE_STREAMING_BUDGET);
 	initModels();
 	initSkyBox();
+	uploadTextures();
+#ifdef GPS_BENCHMARK_TEXTURE_DECODE
+	gps::RunDecodeBenchmark();
+#endif
 	initShaders();
 	initUniforms();
+	initRenderPasses();
     setWindowCallbacks();
 
+	// the setup above changed GL state behind the state cache's back
+	gps::GLStateCache::GetInstance().Invalidate();
+
 	glCheckError();
 	// application loop
 	while (!glfwWindowShouldClose(myWindow.getWindow())) {
+		gps::UniformStatistics frameStart = gps::Shader::getUniformStatistics();
+		gps::GLStateStatistics stateStart = gps::GLStateCache::GetInstance().GetStatistics();
+		gps::DrawStatistics drawStart = gps::GeometryArena::GetInstance().GetDrawStatistics();
+		gps::RenderQueueStatistics queueStart = gps::RenderQueue::GetInstance().GetStatistics();
+		gps::Culling::CullStatistics cullStart = gps::Culling::GetStatistics();
         processMovement();
+		if (gps::TextureUploader::GetInstance().Update()) {
+			gps::TextureCache::GetInstance().PrintStatistics();
+		}
 	    renderScene();
 
+		gps::UniformStatistics frameEnd = gps::Shader::getUniformStatistics();
+		frameUniforms.driverLookups = frameEnd.driverLookups - frameStart.driverLookups;
+		frameUniforms.cachedLookups = frameEnd.cachedLookups - frameStart.cachedLookups;
+		gps::GLStateStatistics stateEnd = gps::GLStateCache::GetInstance().GetStatistics();
+		frameState.issued = stateEnd.issued - stateStart.issued;
+		frameState.skipped = stateEnd.skipped - stateStart.skipped;
+		gps::DrawStatistics drawEnd = gps::GeometryArena::GetInstance().GetDrawStatistics();
+		frameDraws.drawCalls = drawEnd.drawCalls - drawStart.drawCalls;
+		frameDraws.meshes = drawEnd.meshes - drawStart.meshes;
+		gps::RenderQueueStatistics queueEnd = gps::RenderQueue::GetInstance().GetStatistics();
+		frameQueue.draws = queueEnd.draws - queueStart.draws;
+		frameQueue.unsortedChanges = queueEnd.unsortedChanges - queueStart.unsortedChanges;
+		frameQueue.sortedChanges = queueEnd.sortedChanges - queueStart.sortedChanges;
+		gps::Culling::CullStatistics cullEnd = gps::Culling::GetStatistics();
+		for (int pass = 0; pass < gps::Culling::PASS_COUNT; pass++) {
+			frameCulling.visible[pass] = cullEnd.visible[pass] - cullStart.visible[pass];
+			frameCulling.culled[pass] = cullEnd.culled[pass] - cullStart.culled[pass];
+			frameCulling.visibleTriangles[pass] = cullEnd.visibleTriangles[pass] - cullStart.visibleTriangles[pass];
+			frameCulling.culledTriangles[pass] = cullEnd.culledTriangles[pass] - cullStart.culledTriangles[pass];
+			frameCulling.backfaceTriangles[pass] = cullEnd.backfaceTriangles[pass] - cullStart.backfaceTriangles[pass];
+		}
+
 		glfwPollEvents();
 		glfwSwapBuffers(myWindow.getWindow());
 
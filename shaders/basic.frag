@@ -4,7 +4,7 @@ in vec3 fPosition;
 in vec3 fNormal;
 in vec2 fTexCoords;
 in vec4 fragPosEye;
-in vec4 fragPosLightSpace;
+in vec4 fragPosWorld;
 
 out vec4 fColor;
 
@@ -21,7 +21,47 @@ uniform vec3 lightColor;
 // textures
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
-uniform sampler2D shadowMap;
+// the cascades twice: with depth comparison and bilinear filtering, so one tap is a
+// 2x2 PCF, and as raw depths for the hard and PCSS blocker lookups
+uniform sampler2DArrayShadow shadowMap;
+uniform sampler2DArray shadowDepth;
+
+// shadow filtering, picked by the program variant (see main.cpp)
+#define SHADOW_FILTER_HARD 0
+#define SHADOW_FILTER_HARDWARE_PCF 1
+#define SHADOW_FILTER_DISK 2
+#define SHADOW_FILTER_PCSS 3
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER SHADOW_FILTER_HARDWARE_PCF
+#endif
+// taps of the rotated disk, for both the disk PCF and PCSS
+#ifndef SHADOW_TAPS
+#define SHADOW_TAPS 16
+#endif
+// disk PCF radius, in texels
+const float SHADOW_FILTER_RADIUS = 1.5f;
+// PCSS: tangent of the light's angular radius and the largest penumbra, in texels
+const float SHADOW_LIGHT_SIZE = 0.02f;
+const float SHADOW_PCSS_MAX_RADIUS = 8.0f;
+// the lookup moves this many texels along the normal and compares this many
+// texels nearer the light, against acne on lit surfaces
+const float SHADOW_NORMAL_OFFSET = 1.0f;
+const float SHADOW_DEPTH_BIAS = 1.0f;
+
+// shadow cascades, same count as gps::SHADOW_CASCADE_COUNT
+const int SHADOW_CASCADE_COUNT = 4;
+uniform mat4 cascadeLightSpace[SHADOW_CASCADE_COUNT];
+// view depth where each cascade ends, and world units per texel in each
+uniform vec4 cascadeSplits;
+uniform vec4 cascadeTexelSizes;
+// debug view, tints each cascade
+uniform bool showCascades;
+
+// point light shadow: six cube faces in a tile of the atlas (see PointShadows.hpp),
+// distance to the light over its range as depth
+uniform sampler2DShadow pointShadowAtlas;
+// tile origin in xy, face size in z (0 without a shadow), range in w
+uniform vec4 pointShadowTile;
 
 //components
 vec3 ambient;
@@ -96,27 +136,148 @@ void computePointLight(vec4 lightPosEye, vec3 pointLightColor)
 }
 
 
-float computeShadow()
+int computeCascade()
+{
+	float depth = -fragPosEye.z;
+	for (int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+		if (depth <= cascadeSplits[i])
+			return i;
+	}
+	return SHADOW_CASCADE_COUNT;
+}
+
+// per-pixel rotation of the sampling disk, turns banding into fine noise
+float interleavedGradientNoise(vec2 position)
+{
+	return fract(52.9829189f * fract(dot(position, vec2(0.06711056f, 0.00583715f))));
+}
+
+// tap i of a golden-angle (Vogel) disk of radius 1, rotated by angle
+vec2 diskTap(int i, float angle)
+{
+	float radius = sqrt((float(i) + 0.5f) / float(SHADOW_TAPS));
+	float theta = float(i) * 2.39996323f + angle;
+	return radius * vec2(cos(theta), sin(theta));
+}
+
+// fraction of the disk around coords that is lit, radius in texture coordinates
+float filterDisk(vec2 coords, int cascade, float reference, vec2 radius, float angle)
+{
+	float lit = 0.0f;
+	for (int i = 0; i < SHADOW_TAPS; i++) {
+		lit += texture(shadowMap, vec4(coords + diskTap(i, angle) * radius, cascade, reference));
+	}
+	return lit / float(SHADOW_TAPS);
+}
+
+// world-space surface normal; normalMatrix undoes the model's decode scale, and the
+// view is rigid, so its transpose takes the eye-space normal back to world space
+vec3 computeWorldNormal()
+{
+	return transpose(mat3(view)) * normalize(normalMatrix * fNormal);
+}
+
+float computeShadow(int cascade)
 {	
-	// perform perspective divide
-    vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	// no shadows past the last cascade
+	if (cascade >= SHADOW_CASCADE_COUNT)
+		return 0.0f;
+
+	mat4 lightSpace = cascadeLightSpace[cascade];
+	float texelSize = cascadeTexelSizes[cascade];
+
+	// look up from a point pushed off the surface, so slopes do not shadow themselves
+	vec3 worldNormal = computeWorldNormal();
+	vec4 fragPosLightSpace = lightSpace * (fragPosWorld + vec4(worldNormal * texelSize * SHADOW_NORMAL_OFFSET, 0.0f));
+
+	// perform perspective divide and transform to [0,1] range
+    vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w * 0.5f + 0.5f;
     if(normalizedCoords.z > 1.0f)
         return 0.0f;
-    
-	// Transform to [0,1] range
-    normalizedCoords = normalizedCoords * 0.5f + 0.5f;
-   
-   // Get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, normalizedCoords.xy).r;    
-   
-   // Get depth of current fragment from light's perspective
-    float currentDepth = normalizedCoords.z;
-   
-   // Check whether current frag pos is in shadow
-    float bias = 0.005f;
-    float shadow = currentDepth - bias> closestDepth  ? 1.0f : 0.0f;
-
-    return shadow;	
+
+	// [0,1] depth per world unit along the light, the cascades have different depth ranges
+	float depthPerUnit = 0.5f * length(vec3(lightSpace[0][2], lightSpace[1][2], lightSpace[2][2]));
+	float reference = normalizedCoords.z - SHADOW_DEPTH_BIAS * texelSize * depthPerUnit;
+	vec2 texel = 1.0f / vec2(textureSize(shadowMap, 0).xy);
+
+#if SHADOW_FILTER == SHADOW_FILTER_HARD
+	float closestDepth = texture(shadowDepth, vec3(normalizedCoords.xy, cascade)).r;
+	return reference > closestDepth ? 1.0f : 0.0f;
+#elif SHADOW_FILTER == SHADOW_FILTER_HARDWARE_PCF
+	return 1.0f - texture(shadowMap, vec4(normalizedCoords.xy, cascade, reference));
+#else
+	float angle = 6.28318531f * interleavedGradientNoise(gl_FragCoord.xy);
+#if SHADOW_FILTER == SHADOW_FILTER_DISK
+	return 1.0f - filterDisk(normalizedCoords.xy, cascade, reference, SHADOW_FILTER_RADIUS * texel, angle);
+#else
+	// blocker search over the largest penumbra allowed
+	float blockerDepth = 0.0f;
+	float blockers = 0.0f;
+	for (int i = 0; i < SHADOW_TAPS; i++) {
+		float depth = texture(shadowDepth, vec3(normalizedCoords.xy + diskTap(i, angle) * SHADOW_PCSS_MAX_RADIUS * texel, cascade)).r;
+		if (depth < reference) {
+			blockerDepth += depth;
+			blockers += 1.0f;
+		}
+	}
+	if (blockers == 0.0f)
+		return 0.0f;
+	blockerDepth /= blockers;
+
+	// the penumbra widens with the distance from the blocker to the receiver
+	float penumbra = (reference - blockerDepth) / depthPerUnit * SHADOW_LIGHT_SIZE / texelSize;
+	float radius = clamp(penumbra, 1.0f, SHADOW_PCSS_MAX_RADIUS);
+	return 1.0f - filterDisk(normalizedCoords.xy, cascade, reference, radius * texel, angle);
+#endif
+#endif
+}
+
+// face directions and up vectors in the order the faces were drawn
+const vec3 FACE_FORWARD[6] = vec3[](vec3(1.0f, 0.0f, 0.0f), vec3(-1.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f),
+	vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, 0.0f, 1.0f), vec3(0.0f, 0.0f, -1.0f));
+const vec3 FACE_UP[6] = vec3[](vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, 0.0f, 1.0f),
+	vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, -1.0f, 0.0f));
+
+float computePointShadow()
+{
+	float faceSize = pointShadowTile.z;
+	float range = pointShadowTile.w;
+	if (faceSize == 0.0f)
+		return 0.0f;
+
+	vec3 toFragment = fragPosWorld.xyz - pointLightPosition;
+	float distance = length(toFragment);
+	if (distance >= range)
+		return 0.0f;
+
+	// world size of a face texel at this distance, for the same offsets as the cascades
+	float texelSize = 2.0f * distance / (faceSize * float(textureSize(pointShadowAtlas, 0).x));
+	vec3 worldNormal = computeWorldNormal();
+	toFragment += worldNormal * texelSize * SHADOW_NORMAL_OFFSET;
+
+	// the face is picked by the major axis, as a cube map would
+	vec3 absolute = abs(toFragment);
+	int face;
+	if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+		face = toFragment.x > 0.0f ? 0 : 1;
+	else if (absolute.y >= absolute.z)
+		face = toFragment.y > 0.0f ? 2 : 3;
+	else
+		face = toFragment.z > 0.0f ? 4 : 5;
+
+	// same projection as the face's lookAt and 90 degree perspective
+	vec3 forward = FACE_FORWARD[face];
+	vec3 side = normalize(cross(forward, FACE_UP[face]));
+	vec3 up = cross(side, forward);
+	vec2 faceCoords = vec2(dot(toFragment, side), dot(toFragment, up)) / dot(toFragment, forward) * 0.5f + 0.5f;
+
+	// kept half a texel inside the face, the filter must not reach into the next one
+	float halfTexel = 0.5f / float(textureSize(pointShadowAtlas, 0).x);
+	vec2 origin = pointShadowTile.xy + vec2(face % 3, face / 3) * faceSize;
+	vec2 coords = origin + clamp(faceCoords * faceSize, vec2(halfTexel), vec2(faceSize - halfTexel));
+
+	float reference = (length(toFragment) - SHADOW_DEPTH_BIAS * texelSize) / range;
+	return 1.0f - texture(pointShadowAtlas, vec3(coords, reference));
 }
 
 float computeFog()
@@ -143,8 +304,13 @@ void main()
 	//computePointLight(lightPosEye2, pointLightColor);
 	//computePointLight(lightPosEye3, pointLightColor);
 
+	float pointShadow = computePointShadow();
+	diffuseP = (1.0 - pointShadow) * diffuseP;
+	specularP = (1.0 - pointShadow) * specularP;
+
 	//modulate with shadow
-	float shadow = computeShadow();
+	int cascade = computeCascade();
+	float shadow = computeShadow(cascade);
 	diffuse = (1.0 - shadow) * diffuse;
 	specular = (1.0 - shadow) * specular;
 
@@ -156,8 +322,14 @@ void main()
     vec3 color = min((ambient + diffuse) * texture(diffuseTexture, fTexCoords).rgb + specular * texture(specularTexture, fTexCoords).rgb, 1.0f);
 
 	float fogFactor = computeFog();
-	vec3 fogColor = vec3(0.5f, 0.5f, 0.5f);	color = fogColor * (1 - fogFactor) + color * fogFactor;
+	vec3 fogColor = vec3(0.5f, 0.5f, 0.5f);
+	color = fogColor * (1 - fogFactor) + color * fogFactor;
+
 
+	if (showCascades && cascade < SHADOW_CASCADE_COUNT) {
+		vec3 cascadeColors[4] = vec3[](vec3(1.0f, 0.2f, 0.2f), vec3(0.2f, 1.0f, 0.2f), vec3(0.2f, 0.2f, 1.0f), vec3(1.0f, 1.0f, 0.2f));
+		color = mix(color, cascadeColors[cascade], 0.4f);
+	}
 
     fColor = vec4(color, 1.0f);
 }
@@ -8,12 +8,13 @@ out vec3 fPosition;
 out vec3 fNormal;
 out vec2 fTexCoords;
 out vec4 fragPosEye;
-out vec4 fragPosLightSpace;
+out vec4 fragPosWorld;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 lightSpaceTrMatrix;
+// packed texture coordinates are 0..1 across the model's range: scale in xy, offset in zw
+uniform vec4 texCoordDecode;
 
 void main() 
 {
@@ -24,7 +25,8 @@ void main()
 	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
 	fPosition = vPosition;
 	fNormal = vNormal;
-	fTexCoords = vTexCoords;
+	fTexCoords = vTexCoords * texCoordDecode.xy + texCoordDecode.zw;
 
-	fragPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	// taken to light space in the fragment shader, once the cascade is known
+	fragPosWorld = model * vec4(vPosition, 1.0f);
 }
@@ -0,0 +1,12 @@
+#version 410 core
+
+in vec3 fragWorldPosition;
+
+uniform vec3 lightPosition;
+uniform float lightRange;
+
+void main()
+{
+    // linear distance, the same on every face and for any depth precision
+    gl_FragDepth = length(fragWorldPosition - lightPosition) / lightRange;
+}
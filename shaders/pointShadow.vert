@@ -0,0 +1,12 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+
+uniform mat4 model;
+
+out vec4 worldPosition;
+
+void main()
+{
+    worldPosition = model * vec4(vPosition, 1.0f);
+}
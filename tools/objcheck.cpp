@@ -0,0 +1,163 @@
+// Conformance check of the parallel OBJ parser: parses every .obj under the given
+// files and directories (default: models) with both gps::LoadObjParallel and the
+// reference tinyobj::LoadObj and reports the first difference. Unlike the
+// GPS_VERIFY_OBJ_PARSER build of the renderer, it does not depend on the mesh
+// cache being stale and covers models the scene does not load.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++14 -I. tools/objcheck.cpp ObjLoader.cpp MappedFile.cpp ThreadPool.cpp tiny_obj_loader.cpp -o objcheck -pthread
+//
+// Usage: objcheck [file.obj | directory]...
+
+#include "ObjLoader.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static bool EndsWith(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Appends the .obj files below path, or path itself when it is a file
+static void FindObjFiles(const std::string& path, std::vector<std::string>& files)
+{
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES) {
+        return;
+    }
+    if (!(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        files.push_back(path);
+        return;
+    }
+    WIN32_FIND_DATAA entry;
+    HANDLE search = FindFirstFileA((path + "/*").c_str(), &entry);
+    if (search == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    std::vector<std::string> names;
+    do {
+        names.push_back(entry.cFileName);
+    } while (FindNextFileA(search, &entry));
+    FindClose(search);
+#else
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) {
+        return;
+    }
+    if (!S_ISDIR(status.st_mode)) {
+        files.push_back(path);
+        return;
+    }
+    DIR* directory = opendir(path.c_str());
+    if (!directory) {
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(directory)) {
+        names.push_back(entry->d_name);
+    }
+    closedir(directory);
+#endif
+
+    // sorted, so the report reads the same on every platform
+    std::sort(names.begin(), names.end());
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == "." || names[i] == "..") {
+            continue;
+        }
+        std::string child = path + "/" + names[i];
+#ifdef _WIN32
+        bool isDirectory = (GetFileAttributesA(child.c_str()) & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+        bool isDirectory = stat(child.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+#endif
+        if (isDirectory || EndsWith(names[i], ".obj")) {
+            FindObjFiles(child, files);
+        }
+    }
+}
+
+static bool CheckFile(const std::string& fileName)
+{
+    // materials are looked up next to the .obj, as Model3D does
+    size_t slash = fileName.find_last_of("/\\");
+    std::string basePath = slash == std::string::npos ? std::string() : fileName.substr(0, slash + 1);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    bool loaded = gps::LoadObjParallel(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), true);
+    std::chrono::steady_clock::time_point parallelEnd = std::chrono::steady_clock::now();
+
+    tinyobj::attrib_t referenceAttrib;
+    std::vector<tinyobj::shape_t> referenceShapes;
+    std::vector<tinyobj::material_t> referenceMaterials;
+    std::string referenceErr;
+    bool referenceLoaded = tinyobj::LoadObj(&referenceAttrib, &referenceShapes, &referenceMaterials, &referenceErr,
+        fileName.c_str(), basePath.c_str(), true);
+    std::chrono::steady_clock::time_point referenceEnd = std::chrono::steady_clock::now();
+
+    if (loaded != referenceLoaded) {
+        std::cerr << "ERROR: " << fileName << ": parallel parser " << (loaded ? "loaded" : "failed") << ", tinyobj "
+            << (referenceLoaded ? "loaded" : "failed") << std::endl;
+        return false;
+    }
+    std::string difference;
+    if (loaded && !gps::CompareObjResults(referenceAttrib, referenceShapes, referenceMaterials, attrib, shapes, materials, &difference)) {
+        std::cerr << "ERROR: " << fileName << ": " << difference << std::endl;
+        return false;
+    }
+
+    double parallelMs = std::chrono::duration<double, std::milli>(parallelEnd - start).count();
+    double referenceMs = std::chrono::duration<double, std::milli>(referenceEnd - parallelEnd).count();
+    std::cout << fileName << " : identical, " << attrib.vertices.size() / 3 << " positions, " << shapes.size()
+        << " shapes, " << (int)parallelMs << " ms parallel, " << (int)referenceMs << " ms tinyobj" << std::endl;
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    std::vector<std::string> roots;
+    for (int i = 1; i < argc; i++) {
+        roots.push_back(argv[i]);
+    }
+    if (roots.empty()) {
+        roots.push_back("models");
+    }
+
+    std::vector<std::string> files;
+    for (size_t i = 0; i < roots.size(); i++) {
+        FindObjFiles(roots[i], files);
+    }
+    if (files.empty()) {
+        std::cerr << "objcheck: no .obj files found" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!CheckFile(files[i])) {
+            failed++;
+        }
+    }
+    std::cout << files.size() - failed << " of " << files.size() << " files parse identically" << std::endl;
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
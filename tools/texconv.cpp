@@ -0,0 +1,144 @@
+// Offline texture converter: writes image.dds next to each input image, BC1 or
+// BC3 compressed with a full mip chain. The renderer picks the .dds up instead
+// of the source image when it is present and not older than the image.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++14 -I. tools/texconv.cpp BlockCompression.cpp Dds.cpp ImageOps.cpp MappedFile.cpp stb_image.cpp -o texconv
+//
+// Usage: texconv [--bc1 | --bc3] [--linear] [--no-flip] image...
+//   --bc1 / --bc3  force the format (default: BC3 if the image has any alpha, else BC1)
+//   --linear       filter the mip chain without the sRGB transfer function
+//   --no-flip      keep the rows top-down, as the skybox faces are loaded (model
+//                  textures are flipped like the runtime decoder flips them); the
+//                  orientation is recorded in the file and the loader flips a
+//                  file converted for the other one
+
+#include "BlockCompression.hpp"
+#include "Dds.hpp"
+#include "ImageOps.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static double GetPSNR(const std::vector<unsigned char>& original, const std::vector<unsigned char>& decoded, int channels)
+{
+    double squaredError = 0.0;
+    size_t samples = 0;
+    for (size_t i = 0; i < original.size(); i += 4) {
+        for (int c = 0; c < channels; c++) {
+            double difference = (double)original[i + c] - decoded[i + c];
+            squaredError += difference * difference;
+            samples++;
+        }
+    }
+    if (squaredError == 0.0) {
+        return 99.0;
+    }
+    return 10.0 * std::log10(255.0 * 255.0 * samples / squaredError);
+}
+
+static bool ConvertImage(const std::string& path, int forcedFormat, bool srgb, bool flip)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    int width, height, n;
+    unsigned char* image_data = stbi_load(path.c_str(), &width, &height, &n, 4);
+    if (!image_data) {
+        fprintf(stderr, "ERROR: could not load %s\n", path.c_str());
+        return false;
+    }
+    std::vector<unsigned char> pixels(image_data, image_data + (size_t)width * height * 4);
+    stbi_image_free(image_data);
+    if (flip) {
+        gps::ImageOps::FlipRows(&pixels[0], width, height, 4);
+    }
+
+    bool hasAlpha = false;
+    for (size_t i = 3; i < pixels.size() && !hasAlpha; i += 4) {
+        hasAlpha = pixels[i] != 255;
+    }
+
+    gps::DdsImage dds;
+    dds.format = forcedFormat >= 0 ? (gps::BlockFormat)forcedFormat : (hasAlpha ? gps::BLOCK_BC3 : gps::BLOCK_BC1);
+    dds.width = width;
+    dds.height = height;
+    dds.bottomUp = flip;
+
+    std::vector<unsigned char> level = pixels;
+    int levelWidth = width, levelHeight = height;
+    while (true) {
+        dds.levels.push_back(gps::CompressImage(&level[0], levelWidth, levelHeight, dds.format));
+        if (levelWidth == 1 && levelHeight == 1) {
+            break;
+        }
+        int nextWidth = std::max(1, levelWidth / 2), nextHeight = std::max(1, levelHeight / 2);
+        std::vector<unsigned char> next((size_t)nextWidth * nextHeight * 4);
+        gps::ImageOps::Downsample(&level[0], levelWidth, levelHeight, 4, srgb, &next[0]);
+        level.swap(next);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+
+    std::string output = gps::GetDdsPath(path);
+    if (!gps::WriteDds(output, dds)) {
+        return false;
+    }
+
+    // decode level 0 again to report the compression error
+    std::vector<unsigned char> decoded = gps::DecompressImage(&dds.levels[0][0], width, height, dds.format);
+    size_t compressedBytes = 0;
+    for (size_t i = 0; i < dds.levels.size(); i++) {
+        compressedBytes += dds.levels[i].size();
+    }
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << output << " : " << (dds.format == gps::BLOCK_BC1 ? "BC1" : "BC3") << " " << width << "x" << height << ", "
+        << dds.levels.size() << " levels, " << compressedBytes / 1024 << " KB (RGBA8 with mips: "
+        << (size_t)width * height * 4 * 4 / 3 / 1024 << " KB), RGB PSNR " << GetPSNR(pixels, decoded, 3) << " dB";
+    if (dds.format == gps::BLOCK_BC3) {
+        std::cout << ", RGBA PSNR " << GetPSNR(pixels, decoded, 4) << " dB";
+    }
+    std::cout << ", " << (int)milliseconds << " ms" << std::endl;
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    int forcedFormat = -1;
+    bool srgb = true;
+    bool flip = true;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bc1") == 0) {
+            forcedFormat = gps::BLOCK_BC1;
+        } else if (strcmp(argv[i], "--bc3") == 0) {
+            forcedFormat = gps::BLOCK_BC3;
+        } else if (strcmp(argv[i], "--linear") == 0) {
+            srgb = false;
+        } else if (strcmp(argv[i], "--no-flip") == 0) {
+            flip = false;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    if (inputs.empty()) {
+        std::cerr << "usage: texconv [--bc1 | --bc3] [--linear] [--no-flip] image..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool succeeded = true;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        succeeded = ConvertImage(inputs[i], forcedFormat, srgb, flip) && succeeded;
+    }
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}